@@ -12,11 +12,41 @@
 ///////////////////////////////////////////////////
 
 #include <fstream>
+#include <sstream>
 #include <cstring>
+#include <cctype>
+#include <climits>
 #include <string>
 #include <math.h>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 #include "BVH.h"
+#include "MappedFile.h"
+#include "MotionParser.h"
+#include "FastFloat.h"
+#include "MotionCache.h"
+#include "CompressedMotion.h"
+#include "Parallel.h"
+
+// files with more motion text than this are streamed in
+#define STREAMING_MIN_BYTES  (4 * 1024 * 1024)
+
+// frames parsed between each update of numFrameLoaded
+#define STREAMING_BATCH  64
+
+// fewer frames than this each and a thread isn't worth starting
+#define FRAMES_PER_WORKER  256
+
+// the same for SolveClipIK, where each frame costs far more
+#define IK_FRAMES_PER_WORKER  16
+
+// IK steps come out in radians but are added to channels in degrees,
+// so one step moves an effector move times this rather than move
+#define IK_MOVE_SCALE  (M_PI / 180.)
+
+// how far the root is dragged for each move
+#define IK_ROOT_MOVE_SCALE  0.1
 
 
 ////////////////////////////////////////////////
@@ -32,12 +62,30 @@ BVH::~BVH()
 BVH::BVH()
 {
 	motion = NULL;
+	motionCapacity = 0;
+	motionFile = NULL;
+	sourceFile = NULL;
+	compressedMotion = NULL;
+  useMotionCache = false;
+  verifyMotionCache = false;
+  useStreaming = true;
+  isStreaming = false;
+  isStreamShort = false;
+  savePrecision = SHORTEST_PRECISION;
+  interpolation = INTERPOLATE_EULER;
+  lerpedInterpolation = INTERPOLATE_EULER;
   moveMode = INVERSEKINEMATICS;
   useDampening = false;
   useControl = false;
   xGain = 1.0;
   yGain = 1.0;
   zGain = 1.0;
+  ikMaxIterations = 1;
+  ikTolerance = 0.;
+  ikTimeBudget = 0;
+  ikTranslationWeight = 0.;
+  ikSolverType = IK_JACOBIAN;
+  ik.SetSolver(IK_JACOBIAN);
   lambda = 0.0;
 	Clear();
   activeJoints.clear();
@@ -47,12 +95,30 @@ BVH::BVH()
 BVH::BVH( const char * bvhFileName )
 {
 	motion = NULL;
+	motionCapacity = 0;
+	motionFile = NULL;
+	sourceFile = NULL;
+	compressedMotion = NULL;
+  useMotionCache = false;
+  verifyMotionCache = false;
+  useStreaming = true;
+  isStreaming = false;
+  isStreamShort = false;
+  savePrecision = SHORTEST_PRECISION;
+  interpolation = INTERPOLATE_EULER;
+  lerpedInterpolation = INTERPOLATE_EULER;
   moveMode = INVERSEKINEMATICS;
   useDampening = false;
   useControl = false;
   xGain = 1.0;
   yGain = 1.0;
   zGain = 1.0;
+  ikMaxIterations = 1;
+  ikTolerance = 0.;
+  ikTimeBudget = 0;
+  ikTranslationWeight = 0.;
+  ikSolverType = IK_JACOBIAN;
+  ik.SetSolver(IK_JACOBIAN);
 	Clear();
 	Load( bvhFileName );
   activeJoints.clear();
@@ -62,12 +128,17 @@ BVH::BVH( const char * bvhFileName )
 void  BVH::Clear()
 {
 	unsigned int  i;
+
+	// stop any frames still being read in
+	cancelLoad = true;
+	WaitForLoad();
+	cancelLoad = false;
+	isStreamShort = false;
 	for ( i=0; i < channels.size(); i++ )
 		delete  channels[ i ];
 	for ( i=0; i < joints.size(); i++ )
 		delete  joints[ i ];
-	if ( motion != NULL )
-		delete  motion;
+	FreeMotion();
 
 	isLoadSuccess = false;
 
@@ -78,10 +149,207 @@ void  BVH::Clear()
 	channels.clear();
 	joints.clear();
 	jointIndex.clear();
+	globalPositions.clear();
+	jointAngles.clear();
+	keyframes.Clear();
+	splines.Resize( 0 );
+	ikLimits.clear();
+	skeleton = Skeleton();
+	localMatrices.clear();
+	globalMatrices.clear();
 
 	numFrame = 0;
+	numFrameLoaded = 0;
+	cFrame = 0;
 	interval = 0.0;
+}
+
+// motion is either our own array or points into a mapped cache
+void  BVH::FreeMotion()
+{
+	if ( motionFile != NULL )
+		delete  motionFile;
+	else if ( motion != NULL )
+		delete[]  motion;
+
+	motionFile = NULL;
 	motion = NULL;
+	motionCapacity = 0;
+
+	if ( compressedMotion != NULL )
+		delete  compressedMotion;
+	compressedMotion = NULL;
+	frameBuffer.clear();
+	frameBufferFrame = -1;
+
+	// anything worked out from the old motion is out of date
+	ClearClipPoses();
+}
+
+// Swaps the dense array for 16 bit samples, about a quarter
+// of the memory, so many clips can be kept open at once
+bool  BVH::Compress()
+{
+	// every frame has to be in before it can be packed
+	WaitForLoad();
+	if ( ! isLoadSuccess || motion == NULL )
+		return false;
+
+	CompressedMotion *  packed = new CompressedMotion();
+	CompressMotion( motion, numFrame, numChannel, *packed );
+
+	FreeMotion();
+	compressedMotion = packed;
+	frameBuffer.resize( numChannel );
+	return true;
+}
+
+// Back to a dense array that can be edited
+void  BVH::Decompress()
+{
+	// a mapped cache is read only, so the first edit copies it out
+	if ( motionFile != NULL )
+		ReserveFrames( numFrame );
+
+	if ( compressedMotion == NULL )
+		return;
+
+	double *  dense = new double[ (long)numFrame * numChannel ];
+	DecompressMotion( *compressedMotion, dense );
+	FreeMotion();
+	motion = dense;
+	motionCapacity = numFrame;
+
+	// the joints were pointing at frameBuffer
+	if ( cFrame >= 0 && cFrame < numFrame )
+		for ( unsigned int i = 0; i < joints.size(); i++ )
+			joints[ i ]->dataStart = motion + (long)cFrame * numChannel;
+}
+
+bool  BVH::IsCompressed() const
+{
+	return compressedMotion != NULL;
+}
+
+// Memory the motion takes up, dense or compressed
+size_t  BVH::MotionBytes() const
+{
+	if ( compressedMotion != NULL )
+		return compressedMotion->Bytes();
+	return (size_t)numFrame * numChannel * sizeof( double );
+}
+
+// Dense clips hand back a pointer into motion, compressed ones
+// decode into frameBuffer, which is only valid until the next call
+double *  BVH::FrameData( int frame )
+{
+	if ( compressedMotion == NULL )
+		return motion + (long)frame * numChannel;
+
+	if ( frame != frameBufferFrame )
+	{
+		DecompressFrame( *compressedMotion, frame, frameBuffer.data() );
+		frameBufferFrame = frame;
+	}
+	return frameBuffer.data();
+}
+
+// Creates a joint with everything zeroed, linked under parent
+BVH::Joint *  BVH::AddJoint( Joint * parent, const string & name )
+{
+	Joint *  joint = new Joint();
+	joint->index = joints.size();
+	joint->parent = parent;
+	joint->name = name;
+	joint->hasSite = false;
+	joint->offset[0] = 0.0;  joint->offset[1] = 0.0;  joint->offset[2] = 0.0;
+	joint->site[0] = 0.0;  joint->site[1] = 0.0;  joint->site[2] = 0.0;
+	joint->localMatrix = glm::mat4( 1.0f );
+	joint->globalMatrix = glm::mat4( 1.0f );
+	joint->dataStart = NULL;
+	joints.push_back( joint );
+	if ( parent )
+		parent->children.push_back( joint );
+
+	// set Joint name to thisJoint name
+	jointIndex[ name ] = joint;
+
+  // set a default global position
+  globalPositions.push_back(0.);
+  globalPositions.push_back(0.);
+  globalPositions.push_back(0.);
+
+  // set a default rotation
+  jointAngles.push_back(0.);
+  jointAngles.push_back(0.);
+  jointAngles.push_back(0.);
+
+	return joint;
+}
+
+// Creates the next channel in the file and gives it to joint
+BVH::Channel *  BVH::AddChannel( Joint * joint, ChannelEnum type )
+{
+	Channel *  channel = new Channel();
+	channel->joint = joint;
+	channel->type = type;
+	channel->index = channels.size();
+	channels.push_back( channel );
+	joint->channels.push_back( channel );
+	return channel;
+}
+
+////////////////////////////////////////////////
+// PARSING HELPERS
+// These all work straight on the mapped file
+// so a line is never copied anywhere
+////////////////////////////////////////////////
+
+// A word inside the mapped file
+struct Token
+{
+  const char * start;
+  size_t length;
+};
+
+// same separators strtok used to get
+static bool IsSeparator( char c )
+{
+  return c == ' ' || c == ':' || c == ',' || c == '\t' || c == '\r';
+}
+
+// finds the newline ending the line starting at p
+static const char * LineEnd( const char * p, const char * end )
+{
+  const char * newline = (const char *)memchr( p, '\n', end - p );
+  return newline ? newline : end;
+}
+
+// reads the next word on a line, length 0 when there are none left
+static Token NextToken( const char *& p, const char * lineEnd )
+{
+  Token token;
+  while ( p < lineEnd && IsSeparator( *p ) )  p++;
+  token.start = p;
+  while ( p < lineEnd && ! IsSeparator( *p ) )  p++;
+  token.length = p - token.start;
+  return token;
+}
+
+static bool TokenIs( const Token & token, const char * word )
+{
+  size_t length = strlen( word );
+  return token.length == length && memcmp( token.start, word, length ) == 0;
+}
+
+// the mapped file has no null terminators, so numbers
+// are read with the same parser the MOTION block uses
+static double TokenToDouble( const Token & token )
+{
+  const char * p = token.start;
+  double value = 0.0;
+  if ( ! ParseDouble( p, token.start + token.length, value ) )  return 0.0;
+  return value;
 }
 
 ////////////////////////////////////////////////
@@ -91,46 +359,22 @@ void  BVH::Clear()
 ////////////////////////////////////////////////
 void  BVH::Load( const char * bvhFileName )
 {
-	#define  BUFFER_LENGTH  1024*4
-
-	ifstream  file;
-	char      line[ BUFFER_LENGTH ];
-	char *    token;
-	char      separater[] = " :,\t";
+	MappedFile  file;
+	const char *  p;          // where we are reading
+	const char *  end;        // end of the mapped file
+	const char *  lineStart;  // first byte of the current line
+	const char *  line;       // start of the current line
+	const char *  lineEnd;    // end of the current line
+	Token     token;
 	vector< Joint * >   jointStack; // how a good night starts
 	Joint *   joint = NULL;
 	Joint *   newJoint = NULL;
 	bool      isSite = false;
 	double    x, y ,z;
-	unsigned int       i, j;
 
 	// Just make sure everything is reset
 	Clear();
 
-  ///////////////////////////////
-  // FIRST READ
-  //////////////////////////////
-  // first we read the file in for saving purposes later
-  file.open( bvhFileName, ios::in );
-  std::vector<char> charVec;
-	if ( file.is_open() == 0 )  return; // can't be opened for whatever reason
-	while ( ! file.eof() )
-  {
-    file.getline( line, BUFFER_LENGTH );
-
-    if(strcmp(line,"MOTION\r") == 0){ break; }
-    if(strcmp(line,"MOTION") == 0){ break; }
-
-    for(int i = 0; i < strlen(line); i++)
-    {
-      charVec.push_back(line[i]);
-    }
-    charVec.push_back('\n');
-
-  }
-  file.close();
-  fileContents = std::string(charVec.begin(), charVec.end());
-
 	// finds the motion name from the file name
   // with a bunch of char * operations
 	fileName = bvhFileName;
@@ -151,35 +395,44 @@ void  BVH::Load( const char * bvhFileName )
 
 	motionName.assign( mnFirst, mnLast );
 
-	// Read in from buffer
-	file.open( bvhFileName, ios::in );
-	if ( file.is_open() == 0 )  return; // can't be opened for whatever reason
+	// A cache newer than the file skips parsing altogether
+	string  cacheFileName = CacheFileName( bvhFileName );
+	if ( useMotionCache && IsCacheFresh( bvhFileName, cacheFileName.c_str() ) )
+	{
+		if ( LoadCache( cacheFileName.c_str() ) )
+		{
+			numFrameLoaded = numFrame;
+			isLoadSuccess = true;
+			return;
+		}
+		Clear();
+		fileName = bvhFileName;
+		motionName.assign( mnFirst, mnLast );
+	}
+
+  // map the whole file once, everything below
+  // is parsed straight out of the mapped bytes
+	if ( ! file.Open( bvhFileName ) )  return; // can't be opened for whatever reason
+	p = file.data;
+	end = file.data + file.size;
 
   ///////////////////////////////////
 	// HEIRARCHY READ IN
   ///////////////////////////////////
-	while ( ! file.eof() )
+	while ( p < end )
 	{
-
-		// Stream closed while reading
-		if ( file.eof() )  goto bvh_error;
-
-		// Read a bit more data
-		file.getline( line, BUFFER_LENGTH );
-		token = strtok( line, separater );
-
-
-    // Remove Carridge Returns to Avoid Errors
-    if((int)token[strlen(token) -1] == 13)
-    {
-      token[strlen(token) - 1] = '\0';
-    }
+		// Find the next line, lines can be any length
+		lineStart = p;
+		line = p;
+		lineEnd = LineEnd( p, end );
+		p = ( lineEnd < end ) ? lineEnd + 1 : end;
+		token = NextToken( line, lineEnd );
 
 		// Empty Space or Null
-		if ( token == NULL ){ continue; };
+		if ( token.length == 0 ){ continue; };
 
 		// New JOINT discovered
-		if ( strcmp( token, "{" ) == 0)
+		if ( TokenIs( token, "{" ) )
 		{
 			// add to class joints
 			jointStack.push_back( joint );
@@ -190,10 +443,11 @@ void  BVH::Load( const char * bvhFileName )
 		}
 
 		// Now we are talking about the parent again
-		if ( strcmp( token, "}" ) == 0 )
+		if ( TokenIs( token, "}" ) )
 		{
 			// go back to the parent
       // cannot be a site
+			if ( jointStack.empty() )  return;
 			joint = jointStack.back();
 			jointStack.pop_back();
 			isSite = false;
@@ -201,59 +455,35 @@ void  BVH::Load( const char * bvhFileName )
 		}
 
 		// Both can be treaded as the same
-		if ( ( strcmp( token, "ROOT" ) == 0 ) ||
-		     ( strcmp( token, "JOINT" ) == 0 ) )
+		if ( TokenIs( token, "ROOT" ) || TokenIs( token, "JOINT" ) )
 		{
-			// Create Joint Info and Push Back
-			newJoint = new Joint();
-			newJoint->index = joints.size();
-			newJoint->parent = joint;
-			newJoint->hasSite = false;
-			newJoint->offset[0] = 0.0;  newJoint->offset[1] = 0.0;  newJoint->offset[2] = 0.0;
-			newJoint->site[0] = 0.0;  newJoint->site[1] = 0.0;  newJoint->site[2] = 0.0;
-			joints.push_back( newJoint );
-			if ( joint )
-				joint->children.push_back( newJoint );
-
-			// Remove white space to get Joint name
-			token = strtok( NULL, "" );
-			while ( *token == ' ' )  token ++;
-			newJoint->name = token;
-
-			// set Joint name to thisJoint name
-			jointIndex[ newJoint->name ] = newJoint;
-
-      // set a default global position
-      globalPositions.push_back(0.);
-      globalPositions.push_back(0.);
-      globalPositions.push_back(0.);
-
-      // set a default rotation
-      jointAngles.push_back(0.);
-      jointAngles.push_back(0.);
-      jointAngles.push_back(0.);
+			// Remove white space either side to get Joint name
+			while ( line < lineEnd && ( *line == ' ' || *line == '\t' ) )  line ++;
+			while ( lineEnd > line && isspace( (unsigned char)lineEnd[ -1 ] ) )  lineEnd --;
 
+			// Create Joint Info and Push Back
+			newJoint = AddJoint( joint, string( line, lineEnd ) );
 			continue;
 		}
 
 		// Sites e.g. head, fingertips
-		if ( ( strcmp( token, "End" ) == 0 ) )
+		if ( TokenIs( token, "End" ) )
 		{
 			newJoint = joint;
 			isSite = true;
 			continue;
 		}
 
+		// Anything else needs a joint to belong to
+		if ( joint == NULL && ! TokenIs( token, "MOTION" ) )  continue;
+
 		// Next read in the OFFSET as either site/offset
-		if ( strcmp( token, "OFFSET" ) == 0 )
+		if ( TokenIs( token, "OFFSET" ) )
 		{
 			// split and convert string to double
-			token = strtok( NULL, separater );
-			x = token ? atof( token ) : 0.0;
-			token = strtok( NULL, separater );
-			y = token ? atof( token ) : 0.0;
-			token = strtok( NULL, separater );
-			z = token ? atof( token ) : 0.0;
+			x = TokenToDouble( NextToken( line, lineEnd ) );
+			y = TokenToDouble( NextToken( line, lineEnd ) );
+			z = TokenToDouble( NextToken( line, lineEnd ) );
 
 			// Positional data is either a site
 			if ( isSite )
@@ -274,42 +504,40 @@ void  BVH::Load( const char * bvhFileName )
 		}
 
 		// Convert words in file to enums
-		if ( strcmp( token, "CHANNELS" ) == 0 )
+		if ( TokenIs( token, "CHANNELS" ) )
 		{
-			// Read how many channels there are and resize vector
-			token = strtok( NULL, separater );
-			joint->channels.resize( token ? atoi( token ) : 0 );
+			// Read how many channels there are
+			int  numJointChannels = (int)TokenToDouble( NextToken( line, lineEnd ) );
 
 			// Loop through previously discovered number and assign
-			for (i = 0; i < joint->channels.size(); i++ )
+			for ( int c = 0; c < numJointChannels; c++ )
 			{
 				// Create a new instance of Channel to link to Joint
-				Channel *  channel = new Channel();
-				channel->joint = joint;
-				channel->index = channels.size();
-				channels.push_back( channel );
-				joint->channels[ i ] = channel;
+				Channel *  channel = AddChannel( joint, X_ROTATION );
 
 				// Big if statment innit
-				token = strtok( NULL, separater );
-				if ( strcmp( token, "Xrotation" ) == 0 )
+				token = NextToken( line, lineEnd );
+				if ( TokenIs( token, "Xrotation" ) )
 					channel->type = X_ROTATION;
-				else if ( strcmp( token, "Yrotation" ) == 0 )
+				else if ( TokenIs( token, "Yrotation" ) )
 					channel->type = Y_ROTATION;
-				else if ( strcmp( token, "Zrotation" ) == 0 )
+				else if ( TokenIs( token, "Zrotation" ) )
 					channel->type = Z_ROTATION;
-				else if ( strcmp( token, "Xposition" ) == 0 )
+				else if ( TokenIs( token, "Xposition" ) )
 					channel->type = X_POSITION;
-				else if ( strcmp( token, "Yposition" ) == 0 )
+				else if ( TokenIs( token, "Yposition" ) )
 					channel->type = Y_POSITION;
-				else if ( strcmp( token, "Zposition" ) == 0 )
+				else if ( TokenIs( token, "Zposition" ) )
 					channel->type = Z_POSITION;
 			}
+			continue;
 		}
 
 		// Oh No! We Read Too Far, Abandon Ship!
-		if ( strcmp( token, "MOTION" ) == 0 )
+		if ( TokenIs( token, "MOTION" ) )
     {
+      // keep the hierarchy text for saving later
+      fileContents.assign( file.data, lineStart - file.data );
       break;
     }
 	}
@@ -318,846 +546,704 @@ void  BVH::Load( const char * bvhFileName )
   ///////////////////////////////////
 
   // read in number of frames
-	file.getline( line, BUFFER_LENGTH );
-
-	token = strtok( line, separater );
-
-	if ( strcmp( token, "Frames" ) != 0 )  goto bvh_error;
-	token = strtok( NULL, separater );
-	if ( token == NULL )  goto bvh_error;
-	numFrame = atoi( token );
+	do
+	{
+		if ( p >= end )  return;
+		line = p;
+		lineEnd = LineEnd( p, end );
+		p = ( lineEnd < end ) ? lineEnd + 1 : end;
+		token = NextToken( line, lineEnd );
+	} while ( token.length == 0 );
+
+	if ( ! TokenIs( token, "Frames" ) )  return;
+	token = NextToken( line, lineEnd );
+	if ( token.length == 0 )  return;
+	double  frames = TokenToDouble( token );
+	if ( ! ( frames >= 0. && frames <= INT_MAX ) )  return;
+	numFrame = (int)frames;
 
   // read in FPS
-	file.getline( line, BUFFER_LENGTH );
-	token = strtok( line, ":" );
-	if ( strcmp( token, "Frame Time" ) != 0 )  goto bvh_error;
-	token = strtok( NULL, separater );
-	if ( token == NULL )  goto bvh_error;
-	interval = atof( token );
-
+	if ( p >= end )  return;
+	line = p;
+	lineEnd = LineEnd( p, end );
+	p = ( lineEnd < end ) ? lineEnd + 1 : end;
+	if ( ! TokenIs( NextToken( line, lineEnd ), "Frame" ) )  return;
+	if ( ! TokenIs( NextToken( line, lineEnd ), "Time" ) )  return;
+	token = NextToken( line, lineEnd );
+	if ( token.length == 0 )  return;
+	interval = TokenToDouble( token );
+
+	// a clip this big needs a long to index, and must have something in it
 	numChannel = channels.size();
-	motion = new double[ numFrame * numChannel ];
+	if ( numFrame <= 0 || numChannel <= 0 )  return;
+	BuildSkeleton();
+	motion = new double[ (long)numFrame * numChannel ];
+	motionCapacity = numFrame;
+
+	// Long captures only parse the first few frames here, so there is
+	// something to draw straight away, and stream in the rest
+	if ( useStreaming && end - p >= STREAMING_MIN_BYTES && numFrame > STREAMING_BATCH )
+	{
+		if ( ParseMotionFrames( p, end, motion, STREAMING_BATCH, numChannel ) != STREAMING_BATCH )
+			return;
+		numFrameLoaded = STREAMING_BATCH;
+		isLoadSuccess = true;
+
+		// the thread reads from the mapping, so it has to outlive Load
+		sourceFile = new MappedFile();
+		sourceFile->Swap( file );
+		isStreaming = true;
+		loaderThread = std::thread( &BVH::StreamMotion, this, p, end, cacheFileName );
+		return;
+	}
 
 	// Data is all stored sequentially and we already have
   // info to calculate line nums so can just read absolutely
   // everything in to an array, work out who it belongs to
   // later
-	for (i = 0; (int)i < numFrame; i++ )
+	// Frames are independent, so big files are parsed on every core
+	// and the count we get back must agree with the Frames: header
+	int  framesRead = ParseMotionParallel( p, end, motion, numFrame, numChannel );
+	if ( framesRead != numFrame )
 	{
-		file.getline( line, BUFFER_LENGTH );
-		token = strtok( line, separater );
-		for ( j = 0; (int)j < numChannel; j++ )
-		{
-			if ( token == NULL )
-				goto bvh_error;
-			motion[ i * numChannel + j ] = atof( token );
-			token = strtok( NULL, separater );
-		}
+		if ( framesRead >= 0 )
+			std::cerr << bvhFileName << ": Frames: says " << numFrame << " but found " << framesRead << '\n';
+		return;
 	}
-	// Avoids multiple read errors
-	file.close();
+	numFrameLoaded = numFrame;
 
 	// We've made it to the end so
   // something must have went right
 	isLoadSuccess = true;
 
-	return;
-//
-bvh_error:
-	file.close();
+	// next time this file opens it can skip all of the above
+	if ( useMotionCache )
+		SaveCache( cacheFileName.c_str() );
 }
-// Find the Min and Max 3D positions of the root node
-// for camera scaling and bounding boxes
-void BVH::FindMinMax()
+// Runs on loaderThread, publishing frames as they are parsed
+void  BVH::StreamMotion( const char * p, const char * end, string cacheFileName )
 {
-  float minX, maxX, minY, maxY, minZ, maxZ;
-  minX = 99999.;
-  minY = 99999.;
-  minZ = 99999.;
-  maxX = -99999.;
-  maxY = -99999.;
-  maxZ = -99999.;
-
-  double * address;
-  double thisX;
-  double thisY;
-  double thisZ;
-
-  for(int i = 0; i < numFrame; i++)
-  {
-
-    address = motion + i * numChannel;
-
-    thisX = address[0];
-    thisY = address[1];
-    thisZ = address[2];
+	int  loaded = numFrameLoaded;
+	int  framesRead = 0;
+	while ( loaded < numFrame && ! cancelLoad )
+	{
+		int  batch = min( STREAMING_BATCH, numFrame - loaded );
+		framesRead = ParseMotionFrames( p, end, motion + (long)loaded * numChannel, batch, numChannel );
+		if ( framesRead <= 0 )
+			break;
+
+		// frames before this count are complete and safe to draw
+		loaded += framesRead;
+		numFrameLoaded.store( loaded, std::memory_order_release );
+		if ( framesRead < batch )
+			break;
+	}
 
-    if(thisX > maxX) maxX = thisX;
-    if(thisX < minX) minX = thisX;
-    if(thisY > maxY) maxY = thisY;
-    if(thisY < minY) minY = thisY;
-    if(thisZ > maxZ) maxZ = thisZ;
-    if(thisZ < minZ) minZ = thisZ;
-  }
-  // apply to class
-  this->minCoords = Cartesian3(minX, minY, minZ);
-  this->maxCoords = Cartesian3(maxX, maxY, maxZ);
+	// WaitForLoad fails the load, as Load does when it parses it all at once
+	if ( loaded != numFrame && ! cancelLoad )
+	{
+		if ( framesRead >= 0 )
+			std::cerr << fileName << ": Frames: says " << numFrame << " but found " << loaded << '\n';
+		isStreamShort = true;
+	}
 
-  this->boundingBoxSize = max(max((maxX - minX), (maxY - minY)), (maxZ - minZ)) + 2.0;
+	// nothing can edit the motion until we finish, so it
+	// still matches the file and is safe to cache
+	if ( loaded == numFrame && useMotionCache )
+		SaveCache( cacheFileName.c_str() );
 
+	isStreaming = false;
 }
 
-void BVH::FindGlobalPosition(Joint *joint, Camera *camera)
+// How many frames from the start of motion are ready to use
+int  BVH::FramesLoaded() const
 {
-  // find the global position
-
-  // find the global position and update it
-  GLfloat matrix[16];
-  glGetFloatv (GL_MODELVIEW_MATRIX, matrix);
-
-  glm::mat4 modelMatrix = glm::make_mat4(matrix);
-
-
-
-  // undo the camera
-  modelMatrix = glm::inverse(camera->GetViewMatrix()) * modelMatrix;
+	return numFrameLoaded.load( std::memory_order_acquire );
+}
 
-  glm::vec4 emp = glm::vec4(0., 0., 0., 1.);
+// True while frames are still being streamed in
+bool  BVH::IsLoading() const
+{
+	return isStreaming;
+}
 
-  glm::vec4 global = modelMatrix * emp;
+// Blocks until streaming is done, anything that edits
+// or saves the whole motion array calls this first
+void  BVH::WaitForLoad()
+{
+	if ( loaderThread.joinable() )
+		loaderThread.join();
 
+	// A short or broken file is rejected whichever way it was read,
+	// so the frames drawn while it streamed go too
+	if ( isStreamShort )
+	{
+		isLoadSuccess = false;
+		numFrameLoaded = 0;
+		isStreamShort = false;
+	}
 
-  // set the global position from what we have just calculated
-  globalPositions[3 * joint->index]     = global[0];
-  globalPositions[3 * joint->index + 1] = global[1];
-  globalPositions[3 * joint->index + 2] = global[2];
+	if ( sourceFile != NULL )
+		delete  sourceFile;
+	sourceFile = NULL;
 }
 
-
-void BVH::MoveJoint(glm::vec3 move)
+// Find the Min and Max 3D positions of every joint and end site,
+// over every frame, for camera scaling and bounding boxes
+void BVH::FindMinMax()
 {
-  // find current joints position and rotation
-  vector<Joint *> moveJoints;
-  int numJoints = activeJoints.size();
-  for(int i = 0; i < numJoints; i ++)
-  {
-    moveJoints.push_back(joints[activeJoints[i]]);
-  }
-  vector<vector<Channel *>> chn;
+  glm::vec3 lo = glm::vec3(99999.);
+  glm::vec3 hi = glm::vec3(-99999.);
 
-  for(int i = 0; i < numJoints; i ++)
-  {
-    chn.push_back(moveJoints[i]->channels);
-  }
+  // only frames that have finished loading
+  int loaded = FramesLoaded();
+  if(skeleton.numJoints != (int)joints.size()){ BuildSkeleton(); }
 
-  ////////////////
-  // ROTATION
-  ///////////////
-  if(moveMode == ROTATE)
-  {
-    for(int j = 0; j < numJoints; j++)
-    {
-      for(int i = 0; i < chn[j].size(); i++)
-      {
-        if(chn[j][i]->type == 0){ moveJoints[j]->dataStart[chn[j][i]->index] += move.x; } // X ROTATION
-        if(chn[j][i]->type == 1){ moveJoints[j]->dataStart[chn[j][i]->index] += move.y; } // Y ROTATION
-        if(chn[j][i]->type == 2){ moveJoints[j]->dataStart[chn[j][i]->index] += move.z; } // Z ROTATION
-      }
-    }
-    return;
-  }
+  // each worker bounds its own frames, then they are combined
+  int numWorkers = min(NumWorkers(), loaded / FRAMES_PER_WORKER + 1);
+  vector<glm::vec3> workerLo(numWorkers, lo);
+  vector<glm::vec3> workerHi(numWorkers, hi);
 
-  /////////////////////
-  // INVERSE KINEMATICS
-  /////////////////////
-  if(moveMode == INVERSEKINEMATICS)
+  ParallelFor(loaded, numWorkers, [&](int first, int last, int worker)
   {
-    /////////////////
-    // ROOT
-    ////////////////
-    for(int j = 0; j < numJoints; j++)
+    vector<glm::mat4> local(joints.size());
+    vector<glm::mat4> global(joints.size());
+    vector<double> buffer;
+    glm::vec3 thisLo = workerLo[worker];
+    glm::vec3 thisHi = workerHi[worker];
+
+    for(int i = first; i < last; i++)
     {
-      if(moveJoints[j]->parent == NULL)
+      skeleton.ForwardKinematics(ThreadFrameData(i, buffer), local.data(), global.data());
+      for(unsigned int j = 0; j < joints.size(); j++)
       {
-        float moveSens = 0.10;
-        for(int i = 0; i < chn[j].size(); i++)
+        glm::vec3 position = glm::vec3(global[j][3]);
+        thisLo = glm::min(thisLo, position);
+        thisHi = glm::max(thisHi, position);
+
+        // the tips of the head, hands and feet
+        if(joints[j]->hasSite)
         {
-          if(chn[j][i]->type == 3){ moveJoints[j]->dataStart[chn[j][i]->index] += move.x * moveSens; } // X MOVEMENT
-          if(chn[j][i]->type == 4){ moveJoints[j]->dataStart[chn[j][i]->index] += move.y * moveSens; } // Y MOVEMENT
-          if(chn[j][i]->type == 5){ moveJoints[j]->dataStart[chn[j][i]->index] += move.z * moveSens; } // Z MOVEMENT
+          glm::vec3 site = glm::vec3(global[j] * glm::vec4(joints[j]->site[0], joints[j]->site[1], joints[j]->site[2], 1.));
+          thisLo = glm::min(thisLo, site);
+          thisHi = glm::max(thisHi, site);
         }
-        return;
       }
     }
+    workerLo[worker] = thisLo;
+    workerHi[worker] = thisHi;
+  });
 
-    ///////////////////////////////
-    // CALCULATE DESIRED POSITION
-    ///////////////////////////////
-
-    // now subtract the worldspace transformation to put
-    // the character in view
-    glm::vec3 offset = glm::vec3(- (maxCoords.x + minCoords.x) / 2., -(maxCoords.y + minCoords.y) / 2., -(minCoords.z - 25.));
+  for(int w = 0; w < numWorkers; w++)
+  {
+    lo = glm::min(lo, workerLo[w]);
+    hi = glm::max(hi, workerHi[w]);
+  }
 
-    // start and end points
-    vector<glm::vec3> p1s;
-    vector<glm::vec3> p2s;
+  // apply to class
+  this->minCoords = Cartesian3(lo.x, lo.y, lo.z);
+  this->maxCoords = Cartesian3(hi.x, hi.y, hi.z);
 
-    for(int i = 0; i < numJoints; i ++)
-    {
-      p1s.push_back(glm::vec3(globalPositions[3 * moveJoints[i]->index    ] + offset.x,
-                              globalPositions[3 * moveJoints[i]->index + 1] + offset.y,
-                              globalPositions[3 * moveJoints[i]->index + 2] + offset.z));
+  this->boundingBoxSize = max(max((hi.x - lo.x), (hi.y - lo.y)), (hi.z - lo.z)) + 2.0;
 
-    }
-    for(int i = 0; i < numJoints; i ++)
-    {
-      p2s.push_back(glm::vec3(p1s[i].x + move.x,
-                              p1s[i].y + move.y,
-                              p1s[i].z + move.z));
-    }
+}
 
-    // find the distance from the root to the desired position
-    glm::vec3 rootPosition = glm::vec3(globalPositions[0] + offset.x,
-                                       globalPositions[1] + offset.y,
-                                       globalPositions[2] + offset.z);
+////////////////////////////////////////////////
+// FORWARD KINEMATICS
+////////////////////////////////////////////////
 
-    vector<float> rootToDesireds;
+// Flattens joints and channels into skeleton, called once the
+// hierarchy is read and again if the joints ever change
+void BVH::BuildSkeleton()
+{
+  skeleton.Resize(joints.size(), channels.size());
 
-    for(int i = 0; i < numJoints; i ++)
+  for(unsigned int j = 0; j < joints.size(); j++)
+  {
+    Joint * joint = joints[j];
+    skeleton.parent[j] = joint->parent == NULL ? -1 : joint->parent->index;
+    skeleton.offset[j] = glm::vec3(joint->offset[0], joint->offset[1], joint->offset[2]);
+
+    // as before, only the root is moved by its position channels
+    skeleton.usesPosition[j] = joint->parent == NULL;
+
+    int rotations = 0;
+    int order = 0;     // the axes read as a base 3 number, XYZ is 0*9 + 1*3 + 2
+    skeleton.channelStart[j] = joint->channels.empty() ? 0 : joint->channels[0]->index;
+    skeleton.channelCount[j] = joint->channels.size();
+    for(unsigned int c = 0; c < joint->channels.size(); c++)
     {
-      rootToDesireds.push_back(glm::distance(rootPosition, p2s[i]));
-    }
-
-    // create jacobian matrix
-    int l = jointAngles.size();
-
-    double jacobian[3 * numJoints][l];
+      Channel * channel = joint->channels[c];
+      skeleton.channelType[channel->index] = channel->type;
 
-    // set all the values to 0
-    for(int i = 0; i < 3 * numJoints; i++)
-    {
-      for(int j = 0; j < l; j++)
+      if(channel->type >= X_POSITION)
       {
-        jacobian[i][j] = 0.;
+        skeleton.positionChannel[3 * j + channel->type - X_POSITION] = channel->index;
       }
-    }
-
-    ///////////////////
-    // derive Jacobian
-    //////////////////
-    float dSigma = .001;
-
-    // find list of parents
-    vector<vector<Joint *>> fwdKs;
-    vector<Joint * > ps;                // parents for each target joint
-
-    fwdKs.resize(numJoints);
-
-    for(int i = 0; i < numJoints; i ++)
-    {
-      ps.push_back(moveJoints[i]->parent);
-    }
-
-    // find all the parents and check if we can possibly make the
-    // movement possible with positional constraints
-    vector<float> longestLengths;
-    for(int i = 0; i < numJoints; i ++)
-    {
-      longestLengths.push_back(0.);
-      fwdKs[i].push_back(moveJoints[i]);
-      longestLengths[i] += sqrt(moveJoints[i]->offset[0]*moveJoints[i]->offset[0] + moveJoints[i]->offset[1]*moveJoints[i]->offset[1] + moveJoints[i]->offset[2]*moveJoints[i]->offset[2]);
-
-      // add all the parents of every joint we care about
-      while(ps[i] != NULL)
-      { // add to the stack
-        fwdKs[i].push_back(ps[i]);
-        // add their length
-        longestLengths[i] += sqrt(ps[i]->offset[0]*ps[i]->offset[0] + ps[i]->offset[1]*ps[i]->offset[1] + ps[i]->offset[2]*ps[i]->offset[2]);
-
-        ps[i] = ps[i]->parent;
+      // BVH files never have more than three
+      else if(rotations < 3)
+      {
+        skeleton.rotationChannel[3 * j + rotations] = channel->index;
+        skeleton.rotationAxis[3 * j + rotations] = channel->type;
+        order = order * 3 + channel->type;
+        rotations++;
       }
     }
+    skeleton.rotationCount[j] = rotations;
 
-    // now adjust the target position to never be too long
-    // again iterating over each moved joint individually
-    // for(int i = 0; i < numJoints; i ++)
-    // {
-    //   if(rootToDesireds[i] > longestLengths[i])
-    //   {
-    //     float ratio = longestLengths[i] / rootToDesireds[i];
-    //
-    //     p2s[i] =   glm::vec3(((p2s[i].x - rootPosition.x) * ratio) + rootPosition.x,
-    //                          ((p2s[i].y - rootPosition.y) * ratio) + rootPosition.y,
-    //                          ((p2s[i].z - rootPosition.z) * ratio) + rootPosition.z);
-    //   }
-    // }
-    // local position of end effector
-
-    Joint *cJ;       // current joint
-    int cIndex;      // current index
-    glm::vec4 cPos;  // homogenius current position
-    glm::vec3 rotAxis; // roatation axis we are calculating
-    glm::mat4 m;       // matrix for forward kinematics
-    glm::mat4 mFinal;  // multiplicitive sum of matricies
-    glm::vec4 thisTranslation;
-    int numChannels = 0;
-    int thisAction = -1;
-
-    bool valid = true;  // is the channel we are iterating on valid
-    m = glm::mat4(1.);
-
-    glm::vec3 change; // final position change
-
-    // for all the joints we want to move
-    for(int j = 0; j < numJoints; j++)
+    // only the six orders that use each axis once get a name
+    RotationOrder rotationOrder = rotations == 0 ? ROTATION_NONE : ROTATION_OTHER;
+    if(rotations == 3)
     {
-      for(int cParent = fwdKs[j].size() - 1; cParent >  -1; cParent--)
+      switch(order)
       {
-        // how many channels this specific joint has
-        numChannels = fwdKs[j][cParent]->channels.size();
-
-        // iterate over every channel the joint has
-        for(int chn = 0; chn < numChannels; chn++)
-        {
-          valid = true;
-          // find out which action we are reffering to
-          switch(fwdKs[j][cParent]->channels[chn]->type)
-          {
-            case(X_POSITION): valid = false; break;
-            case(Y_POSITION): valid = false; break;
-            case(Z_POSITION): valid = false; break;
-            case(X_ROTATION): thisAction = X_ROTATION; break;
-            case(Y_ROTATION): thisAction = Y_ROTATION; break;
-            case(Z_ROTATION): thisAction = Z_ROTATION; break;
-          }
-          // we cannot make a Jacobian from this element
-          if(valid == false){ continue; }
-
-          // reset matrix chain
-          //matrixChain.clear();
-          mFinal = glm::mat4(1.);
-
-          // forward Kinematics with one
-          // extra rotation
-          for(int i = fwdKs[j].size() - 1; i > -1; i--)
-          {
-
-            // which joint we are talking about
-            cJ = fwdKs[j][i];
-            cIndex = cJ->index;
-
-            // get the local matrix
-            m = cJ->localMatrix;
-
-            // if this is the start position we are interested in
-            // apply the small delta rotation
-            if(i == cParent)
-            {
-              // find the correct rotation axis
-              if(thisAction == X_ROTATION){ rotAxis = glm::vec3(m[0][0], m[0][1], m[0][2]); }
-              if(thisAction == Y_ROTATION){ rotAxis = glm::vec3(m[1][0], m[1][1], m[1][2]); }
-              if(thisAction == Z_ROTATION){ rotAxis = glm::vec3(m[2][0], m[2][1], m[2][2]); }
-
-              // rotate by the corract axis in local space
-              m = glm::rotate(m, dSigma, rotAxis);
-            }
-
-            // add to the matrix chain
-            mFinal = mFinal * m;
-          }
-          cPos.x = 0.;
-          cPos.y = 0.;
-          cPos.z = 0.;
-          cPos.w = 1.;
-
-          cPos = mFinal * cPos ;
-
-          change = (glm::vec3(cPos.x, cPos.y, cPos.z) - p1s[j]);
-
-          // Now loop over all the channels the Joint has
-          // we must find the X, Y, and Z components
-          // to find the correct index
-
-          // making sure to subtract 3 as we do not care
-          // about Root Positon.
-
-          // find which channel we need to update
-          int chnIdx = 0;
-          for(int act = 0; act < fwdKs[j][cParent]->channels.size(); act++)
-          {
-            if(fwdKs[j][cParent]->channels[act]->type == thisAction)
-            {
-              chnIdx = fwdKs[j][cParent]->channels[act]->index - 3;
-            }
-          }
-
-          // only fill in the rotatations if the joint has the ability to rotate
-          // in that axis
-          for(int c = 0; c < fwdKs[j][cParent]->channels.size(); c++)
-          {
-            switch(fwdKs[j][cParent]->channels[c]->type)
-            {
-              case(X_ROTATION):
-              jacobian[(3 * j) + 0][chnIdx] = change.x / dSigma;
-              break;
-              case(Y_ROTATION):
-              jacobian[(3 * j) + 1][chnIdx] = change.y / dSigma;
-              break;
-              case(Z_ROTATION):
-              jacobian[(3 * j) + 2][chnIdx] = change.z / dSigma;
-              break;
-            }
-          }
-        }
-        //exit(0);
+        case(0 * 9 + 1 * 3 + 2): rotationOrder = ROTATION_XYZ; break;
+        case(0 * 9 + 2 * 3 + 1): rotationOrder = ROTATION_XZY; break;
+        case(1 * 9 + 0 * 3 + 2): rotationOrder = ROTATION_YXZ; break;
+        case(1 * 9 + 2 * 3 + 0): rotationOrder = ROTATION_YZX; break;
+        case(2 * 9 + 0 * 3 + 1): rotationOrder = ROTATION_ZXY; break;
+        case(2 * 9 + 1 * 3 + 0): rotationOrder = ROTATION_ZYX; break;
       }
     }
-    // now our jacobian is filled in with all the possible rotations
-    // for however many joints we select
+    skeleton.rotationOrder[j] = rotationOrder;
+  }
+  skeleton.ChooseEvaluators();
 
-    /////////////////////////
-    // Solve Jacobian
-    ////////////////////////
+  // limits only mean anything for the joints they were set on
+  if(ikLimits.size() != joints.size()){ ikLimits.assign(joints.size(), IKLimits()); }
 
-    // V matrix
-    Eigen::VectorXd v(3 * numJoints);
+  localMatrices.assign(joints.size(), glm::mat4(1.));
+  globalMatrices.assign(joints.size(), glm::mat4(1.));
+}
 
-    for(int i = 0; i < numJoints; i ++)
-    {
-      v[(3 * i) + 0] = (double)(p2s[i].x - p1s[i].x);
-      v[(3 * i) + 1] = (double)(p2s[i].y - p1s[i].y);
-      v[(3 * i) + 2] = (double)(p2s[i].z - p1s[i].z);
-    }
+// The skeleton does the maths in one linear pass, this just
+// copies the results back out to the joints for the GUI and IK
+void BVH::ForwardKinematics(const double * data)
+{
+  if(skeleton.numJoints != (int)joints.size()){ BuildSkeleton(); }
+  skeleton.ForwardKinematics(data, localMatrices.data(), globalMatrices.data());
 
-    Eigen::MatrixXd jaco(3 * numJoints, l);
-    // copy values in
-    for(int i = 0; i < (3 * numJoints); i++)
-    {
-      for(int j = 0; j < l; j++)
-      {
-        jaco.row(i)[j] = (double)jacobian[i][j]; // set to 0.
-      }
-    }
-    // J transpose
-    Eigen::MatrixXd jacoT = jaco.transpose();
+  glm::vec3 sceneOffset = SceneOffset();
+  for(unsigned int j = 0; j < joints.size(); j++)
+  {
+    Joint * joint = joints[j];
 
-    // (J * J Transpose)^-1
-    Eigen::MatrixXd psJaco = (jaco * jacoT);
+    // remeber where the data reading starts
+    // for editing later
+    joint->dataStart = (double *)data;
+    joint->localMatrix = localMatrices[j];
+    joint->globalMatrix = globalMatrices[j];
 
-    //////////////////////////////
-    // DAMPENED INVERSE KINEMATICS
-    //////////////////////////////
-    if(useDampening)
+    for(int r = 0; r < skeleton.rotationCount[j]; r++)
     {
-      // make an idnetity matrix of the correct size
-      // and multiply by lamda squared
-      Eigen::MatrixXd iden = Eigen::MatrixXd::Identity(numJoints * 3, numJoints * 3);
-      iden = iden * (lambda * lambda);
-      psJaco = psJaco + iden;
+      jointAngles[3 * j + skeleton.rotationAxis[3 * j + r]] = data[skeleton.rotationChannel[3 * j + r]];
     }
 
-    psJaco = psJaco.inverse();
-    psJaco = jacoT * psJaco;
+    // where the control point for this joint is drawn
+    glm::vec3 position = glm::vec3(globalMatrices[j][3]) + sceneOffset;
+    globalPositions[3 * j]     = position.x;
+    globalPositions[3 * j + 1] = position.y;
+    globalPositions[3 * j + 2] = position.z;
+  }
+}
 
-    // psJaco * V = delta
-    Eigen::MatrixXd deltaM;;
+void BVH::ForwardKinematics(int frameNo)
+{
+  if(frameNo < 0 || frameNo >= FramesLoaded()){ return; }
+  ForwardKinematics(FrameData(frameNo));
+}
 
+// centres the body's path in x and y and sits it in front of the camera
+glm::vec3 BVH::SceneOffset() const
+{
+  return glm::vec3(-(maxCoords.x + minCoords.x) / 2., -(maxCoords.y + minCoords.y) / 2., minCoords.z - 25.);
+}
 
-    //////////////////////////////
-    // CONTROL INVERSE KINEMATICS
-    //////////////////////////////
-    if(useControl)
-    {
+// Like FrameData, but safe to call from several threads at once as
+// compressed frames are decoded into the caller's own buffer
+const double * BVH::ThreadFrameData(int frame, vector<double> & buffer) const
+{
+  if(compressedMotion == NULL){ return motion + (long)frame * numChannel; }
 
-      // construct identity
-      Eigen::MatrixXd iden = Eigen::MatrixXd::Identity(numChannel - 3, numChannel - 3);
+  buffer.resize(numChannel);
+  DecompressFrame(*compressedMotion, frame, buffer.data());
+  return buffer.data();
+}
 
-      // construct z
-      Eigen::VectorXd z(numChannel - 3);
+void BVH::ClipPoses(int firstFrame, int lastFrame, glm::vec3 * positions, glm::quat * orientations)
+{
+  if(skeleton.numJoints != (int)joints.size()){ BuildSkeleton(); }
 
+  int numJoints = skeleton.numJoints;
+  int count = lastFrame - firstFrame;
+  int numWorkers = min(NumWorkers(), count / FRAMES_PER_WORKER + 1);
 
-      // set all Z values to 0
-      for(int i = 0; i < numChannel - 3; i ++){ z(i) = (double)0.; }
+  // frames don't depend on each other, so each worker takes a run of them
+  ParallelFor(count, numWorkers, [&](int first, int last, int)
+  {
+    vector<glm::mat4> local(numJoints);
+    vector<glm::mat4> global(numJoints);
+    vector<double> buffer;
 
-      // except the positions we want to move
-      int xIdx;
-      int yIdx;
-      int zIdx;
+    for(int i = first; i < last; i++)
+    {
+      skeleton.ForwardKinematics(ThreadFrameData(firstFrame + i, buffer), local.data(), global.data());
 
-      for(int i = 0; i < activeJoints.size(); i++)
+      size_t start = (size_t)i * numJoints;
+      for(int j = 0; j < numJoints; j++)
       {
-        // find the indexes for the X, Y, Z
-        zIdx = joints[activeJoints[i]]->channels[0]->index - 3;
-        yIdx = joints[activeJoints[i]]->channels[1]->index - 3;
-        xIdx = joints[activeJoints[i]]->channels[2]->index - 3;
-
-        z(xIdx) = (double)(xGain * ((p2s[i].x - p1s[i].x) * (p2s[i].x - p1s[i].x)));
-        z(yIdx) = (double)(yGain * ((p2s[i].y - p1s[i].y) * (p2s[i].y - p1s[i].y)));
-        z(xIdx) = (double)(zGain * ((p2s[i].z - p1s[i].z) * (p2s[i].z - p1s[i].z)));
+        positions[start + j] = glm::vec3(global[j][3]);
+        if(orientations != NULL){ orientations[start + j] = glm::quat_cast(glm::mat3(global[j])); }
       }
-
-      deltaM = (psJaco * v) + (psJaco * jaco - iden) * z;
-    }
-
-    else
-    {
-      deltaM = psJaco * v;
     }
+  });
+}
 
-    // check if matrix is invertible
-    for(int i = 0; i < deltaM.size(); i ++){ if(isnan(deltaM(i, 0))){ return; } }
+// Poses for the whole clip, so scrubbing and analysis
+// just look them up instead of running forward kinematics
+bool BVH::ComputeClipPoses()
+{
+  int loaded = FramesLoaded();
+  if(!isLoadSuccess || loaded == 0){ return false; }
+
+  clipPositions.resize((size_t)loaded * joints.size());
+  clipOrientations.resize((size_t)loaded * joints.size());
+  ClipPoses(0, loaded, clipPositions.data(), clipOrientations.data());
+  clipPoseFrames = loaded;
+  return true;
+}
 
-     //////////////////////////
-    // // APPLY CHANGES
-    // /////////////////////////
-    vector<Channel *> chn;
+void BVH::ClearClipPoses()
+{
+  clipPositions.clear();
+  clipPositions.shrink_to_fit();
+  clipOrientations.clear();
+  clipOrientations.shrink_to_fit();
+  clipPoseFrames = 0;
+}
 
-    int jointIndex;
+void BVH::MoveJoint(glm::vec3 move)
+{
+  // dragging shouldn't stall the GUI, so wait until every frame is in
+  if(IsLoading()){ return; }
 
-    Channel *thisChannel;
+  // nothing selected, nothing edited
+  int numJoints = activeJoints.size();
+  if(numJoints == 0){ return; }
 
-    // step through delta M
-    for(int i = 0; i < deltaM.size(); i++)
-    {
-      // the index of the joint this item relates to
-      jointIndex = channels[i + 3]->joint->index;
+  // edits go into the real array, not the decoded frame
+  Decompress();
+  ClearClipPoses();
+  keyframes.Changed(cFrame);
 
-      // find which channel index this reffers to
-      thisChannel = channels[i+3];
+  // the skeleton already knows which value is which axis
+  if(skeleton.numJoints != (int)joints.size()){ BuildSkeleton(); }
 
-      if(thisChannel->type == X_ROTATION) // X
-      {
-        joints[jointIndex]->dataStart[thisChannel->index] += deltaM(i, 0);  // X ROTATION
-      }
-      if(thisChannel->type == Y_ROTATION) // Y
-      {
-        joints[jointIndex]->dataStart[thisChannel->index] += deltaM(i, 0); // Y ROTATION
-      }
-      if(thisChannel->type == Z_ROTATION) // Z
+  ////////////////
+  // ROTATION
+  ///////////////
+  if(moveMode == ROTATE)
+  {
+    for(int j = 0; j < numJoints; j++)
+    {
+      Joint * joint = joints[activeJoints[j]];
+      int index = joint->index;
+      for(int r = 0; r < skeleton.rotationCount[index]; r++)
       {
-        joints[jointIndex]->dataStart[thisChannel->index] += deltaM(i, 0); // Z ROTATION
+        joint->dataStart[skeleton.rotationChannel[3 * index + r]] += move[skeleton.rotationAxis[3 * index + r]];
       }
     }
+    return;
   }
-}
 
-////////////////////////////////////////////////
-// RENDERING FUNCTIONS
-////////////////////////////////////////////////
+  /////////////////////
+  // INVERSE KINEMATICS
+  /////////////////////
+  if(moveMode == INVERSEKINEMATICS)
+  {
+    ///////////////////////////////
+    // CALCULATE DESIRED POSITION
+    ///////////////////////////////
 
+    // where each moved joint should end up, one step on its own
+    // moves it move * IK_MOVE_SCALE, iterating just gets closer.
+    // The root has always been dragged further, and is solved along
+    // with the rest through its position channels.
+    // The matrices are the ones the figure was last drawn with.
+    ik.joints.resize(numJoints);
+    ik.goals.resize(numJoints);
+    for(int i = 0; i < numJoints; i ++)
+    {
+      int index = activeJoints[i];
+      double scale = skeleton.parent[index] < 0 ? IK_ROOT_MOVE_SCALE : IK_MOVE_SCALE;
+      ik.joints[i] = index;
+      ik.goals[i] = glm::dvec3(globalMatrices[index][3]) + glm::dvec3(move) * scale;
+    }
 
-// The initial call to render figure, from this point on
-// will go to the recursive method
-void  BVH::RenderFigure( int frameNo, float scale, Camera *camera)
-{
-  // save the current frame
-  cFrame = frameNo;
-	// Calculate poistion into array to start based on frame
-	RenderFigure( joints[ 0 ], motion + frameNo * numChannel, scale, camera );
+    SolveIK(ik, joints[activeJoints[0]]->dataStart);
+  }
 }
 
-
-// Going to be using a lot of
-// https://www.youtube.com/watch?v=vCadcBR95oU
-void  BVH::RenderFigure(Joint * joint, double * data, float scale, Camera *camera)
+// Steps ik.joints towards ik.goals with ik.solver, until they are
+// close enough or it runs out of steps or time. Only reads the BVH,
+// so other threads can solve other frames with their own workspaces.
+void BVH::SolveIK(IKWorkspace & ik, double *data) const
 {
-	glPushMatrix();
-
-  // remeber where the data reading starts
-  // for editing later
-  joint->dataStart = data;
-
-  // we also calculate the local matrix at this point in time too
-  glm::mat4 tempLocal = glm::mat4(1.); // create the identity
-  float offsets[3] = {0., 0., 0.};
-  GLfloat model[16];
-
-	// If this is the root notde
-	if ( joint->parent == NULL )
-	{
-    offsets[0] = data[0] * scale;
-    offsets[1] = data[1] * scale;
-    offsets[2] = data[2] * scale;
-
-    // also include the translation we for forward kinematics
-    glGetFloatv(GL_MODELVIEW_MATRIX, model);
-	}
-	// If we are an average Joe, find our offset
-	else
-	{
-    offsets[0] = joint->offset[ 0 ] * scale;
-    offsets[1] = joint->offset[ 1 ] * scale;
-    offsets[2] = joint->offset[ 2 ] * scale;
-	}
+  int numJoints = ik.joints.size();
+  ik.BuildChain(*this);
+  ik.effectors.resize(numJoints);
 
-  glTranslatef(offsets[0], offsets[1], offsets[2]);
+  int numColumns = ik.channels.size();
+  ik.best.resize(numColumns);
+  double bestError = 0.;
 
-  // add the translation in our local matrix too
-  tempLocal = glm::translate(tempLocal, glm::vec3(offsets[0]            , offsets[1]            , offsets[2]            ));
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  ik.iterations = 0;
+  while(true)
+  {
+    // where the last step left everything
+    ik.Pose(skeleton, data);
 
-	// Apply local roations for this Joint
-  // and find out the rotations of each joint if available
-	unsigned int  i;
-  double thisRot;
-  glm::vec3 axis;
-	for ( i = 0; i < joint->channels.size(); i++ )
-	{
-		Channel *  channel = joint->channels[ i ];
-    thisRot = data[channel->index];
-		if ( channel->type == X_ROTATION )
+    ik.error = 0.;
+    for(int i = 0; i < numJoints; i++)
     {
-      glRotatef( thisRot, 1.0f, 0.0f, 0.0f );
-      jointAngles[3 * joint->index]   = thisRot; // set X for this joint
-      tempLocal = glm::rotate(tempLocal, (float)glm::radians(thisRot), glm::vec3(1., 0., 0.)); // also find local matrix
-      //tempLocal = glm::rotate(tempLocal, glm::radians(thisRot), glm::vec3(1., 0., 0.));
-    }
-		else if ( channel->type == Y_ROTATION )
-    {
-      glRotatef( data[ channel->index ], 0.0f, 1.0f, 0.0f );
-      jointAngles[3 * joint->index + 1] = thisRot; // set Y for this joint
-      tempLocal = glm::rotate(tempLocal, (float)glm::radians(thisRot), glm::vec3(0., 1., 0.)); // also find local matrix
-      //tempLocal = glm::rotate(tempLocal, glm::radians(thisRot), glm::vec3(0., 1., 0.));
+      ik.effectors[i] = glm::dvec3(ik.globalMatrices[ik.joints[i]][3]);
+
+      ik.error = max(ik.error, glm::length(ik.goals[i] - ik.effectors[i]));
     }
-		else if ( channel->type == Z_ROTATION )
+
+    // goals far off can send a step past them, so remember the closest
+    if(ik.iterations == 0 || ik.error < bestError)
     {
-      glRotatef( data[ channel->index ], 0.0f, 0.0f, 1.0f );
-      jointAngles[3 * joint->index + 2]  = thisRot; // set Z for this joint
-      //tempLocal = glm::rotate(tempLocal, glm::radians(thisRot), glm::vec3(0., 0., 1.)); // also find local matrix
-      tempLocal = glm::rotate(tempLocal, (float)glm::radians(thisRot), glm::vec3(0., 0., 1.));
+      bestError = ik.error;
+      for(int c = 0; c < numColumns; c++){ ik.best[c] = data[ik.channels[c]]; }
     }
-	}
-
-  // set the local matrix
-  joint->localMatrix = tempLocal;
-
-  // Now we have the local matrix for each position
-  FindGlobalPosition(joint, camera);
-
-
-  // we are at the end, so use SITE data
-	if ( joint->children.size() == 0 )
-	{
-		RenderBone(0.0f, 0.0f, 0.0f, joint->site[ 0 ] * scale, joint->site[ 1 ] * scale, joint->site[ 2 ] * scale );
-	}
-	// We are going to a child, so draw to there
-	if ( joint->children.size() == 1 )
-	{
-		Joint *  child = joint->children[ 0 ];
-		RenderBone(0.0f, 0.0f, 0.0f, child->offset[ 0 ] * scale, child->offset[ 1 ] * scale, child->offset[ 2 ] * scale );
-	}
-	// else, draw to midpoint
-	if ( joint->children.size() > 1 )
-	{
-		// calculate the center of your kids
-		float  center[ 3 ] = { 0.0f, 0.0f, 0.0f };
-		for ( i = 0; i < joint->children.size(); i++ )
-		{
-			Joint *  child = joint->children[ i ];
-			center[ 0 ] += child->offset[ 0 ];
-			center[ 1 ] += child->offset[ 1 ];
-			center[ 2 ] += child->offset[ 2 ];
-		}
-		center[ 0 ] /= joint->children.size() + 1;
-		center[ 1 ] /= joint->children.size() + 1;
-		center[ 2 ] /= joint->children.size() + 1;
 
-		// Put this bone at the center of your kids
-		RenderBone(0.0f, 0.0f, 0.0f, center[ 0 ] * scale, center[ 1 ] * scale, center[ 2 ] * scale );
+    if(ik.iterations >= max(ikMaxIterations, 1) || ik.error <= ikTolerance){ break; }
 
-		// Render the Bones of all your children
-		for ( i = 0; i < joint->children.size(); i++ )
-		{
-			Joint *  child = joint->children[ i ];
-			RenderBone(center[ 0 ] * scale, center[ 1 ] * scale, center[ 2 ] * scale,
-				child->offset[ 0 ] * scale, child->offset[ 1 ] * scale, child->offset[ 2 ] * scale );
-		}
-	}
+    // always at least one step, however slow
+    double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    if(ik.iterations > 0 && ikTimeBudget > 0 && elapsed >= ikTimeBudget){ break; }
 
-	// Call this function recursively on children
-	for ( i = 0; i < joint->children.size(); i++ )
-	{
-		RenderFigure( joint->children[ i ], data, scale, camera);
-	}
+    ik.solver->Step(*this, ik, data);
+    ik.iterations++;
+  }
 
-	glPopMatrix();
+  // and never end up further off than that
+  if(ik.error > bestError)
+  {
+    for(int c = 0; c < numColumns; c++){ data[ik.channels[c]] = ik.best[c]; }
+    ik.error = bestError;
+    ik.Pose(skeleton, data);
+  }
 }
 
-
-// Renders a single bone (Happends a lot)
-// returns the local rotation matrix
-void BVH::RenderBone(float x0, float y0, float z0, float x1, float y1, float z1, float bRadius )
+// Swaps the solver MoveJoint and SolveClipIK use
+void BVH::SetIKSolver(int type)
 {
+  if(ik.SetSolver(type)){ ikSolverType = type; }
+}
 
-	// Calculate a from -> to vector
-	GLdouble  dir_x = x1 - x0;
-	GLdouble  dir_y = y1 - y0;
-	GLdouble  dir_z = z1 - z0;
-	GLdouble  bone_length = sqrt( dir_x*dir_x + dir_y*dir_y + dir_z*dir_z );
-
-	// Uses GLU for rendering
-	static GLUquadricObj *  quad_obj = NULL;
-	if ( quad_obj == NULL )
-		quad_obj = gluNewQuadric();
-	gluQuadricDrawStyle( quad_obj, GLU_FILL );
-	gluQuadricNormals( quad_obj, GLU_SMOOTH );
-
-	glPushMatrix();
-
-	// translate to start
-	glTranslated( x0, y0, z0 );
-
-	// if bone is too short, do this to avoid
-  // wierd rendering errors
-	double  length;
-	length = sqrt( dir_x*dir_x + dir_y*dir_y + dir_z*dir_z );
-	if ( length < 0.0001 ) {
-		dir_x = 0.0; dir_y = 0.0; dir_z = 1.0;  length = 1.0;
-	}
-	dir_x /= length;  dir_y /= length;  dir_z /= length;
-
-	// for calculating normals
-	GLdouble  up_x, up_y, up_z;
-	up_x = 0.0;
-	up_y = 1.0;
-	up_z = 0.0;
-
-	// for calculating local rotation matrix
-	double  side_x, side_y, side_z;
-	side_x = up_y * dir_z - up_z * dir_y;
-	side_y = up_z * dir_x - up_x * dir_z;
-	side_z = up_x * dir_y - up_y * dir_x;
-
-  // if bone is too short, do this to avoid
-  // wierd rendering errors
-	length = sqrt( side_x*side_x + side_y*side_y + side_z*side_z );
-	if ( length < 0.0001 ) {
-		side_x = 1.0; side_y = 0.0; side_z = 0.0;  length = 1.0;
-	}
-	side_x /= length;  side_y /= length;  side_z /= length;
-
-  // cross product to calculate up
-	up_x = dir_y * side_z - dir_z * side_y;
-	up_y = dir_z * side_x - dir_x * side_z;
-	up_z = dir_x * side_y - dir_y * side_x;
-
-	// local rotation matrix
-	GLdouble  m[16] = { side_x, side_y, side_z, 0.0,
-      	                    up_x,   up_y,   up_z,   0.0,
-      	                    dir_x,  dir_y,  dir_z,  0.0,
-      	                    0.0,    0.0,    0.0,    1.0 };
-
-	glMultMatrixd( m );
+bool BVH::SetIKLimit(int joint, int axis, double lower, double upper)
+{
+  if(joint < 0 || joint >= (int)joints.size() || axis < 0 || axis > 2 || lower > upper){ return false; }
+  if(skeleton.numJoints != (int)joints.size()){ BuildSkeleton(); }
 
-	//
-	GLdouble radius= bRadius; // defined in class
-	GLdouble slices = 16.0;    // resolution of cyclinder
-	GLdouble stack = 16.0;     // z subdivisions
+  ikLimits[joint].lower[axis] = lower;
+  ikLimits[joint].upper[axis] = upper;
+  return true;
+}
 
-	// with all our new found info, render a gluCylinder
-	gluCylinder( quad_obj, radius, radius, bone_length, slices, stack );
+bool BVH::SetIKWeight(int joint, double weight)
+{
+  if(joint < 0 || joint >= (int)joints.size() || weight < 0.){ return false; }
+  if(skeleton.numJoints != (int)joints.size()){ BuildSkeleton(); }
 
-	glPopMatrix();
+  ikLimits[joint].weight = weight;
+  return true;
 }
 
-// Renders the points where a user can click
-void BVH::RenderControlPoints()
+bool BVH::LoadIKLimits(const char * fileName)
 {
-  GLUquadric *quad;
-  quad = gluNewQuadric();
-
-  // check if we are on a keyframe, if so draw points green
-  bool isKeyframe = false;
-  if (std::find(keyframes.begin(), keyframes.end(), cFrame) != keyframes.end()){ isKeyframe = true; }
+  ifstream file(fileName);
+  if(!file.is_open()){ return false; }
 
-  // save current state and load identity
-  glPushMatrix();
-  //glLoadIdentity();
-  for(int i = 0; i < (globalPositions.size() / 3); i++)
+  string line;
+  while(getline(file, line))
   {
-    // change the colour of the joint to be green if keyframe
-    if(isKeyframe){ glColor3f(0., 0.6, 0.); }
-    else          { glColor3f(0. , 0. , .6); }
-
-    // change the colour to blue if being clicked on
-    for(int j = 0; j < activeJoints.size(); j ++)
+    line = line.substr(0, line.find('#'));
+    istringstream words(line);
+
+    string name;
+    double weight;
+    if(!(words >> name)){ continue; }
+    if(!(words >> weight)){ return false; }
+
+    map<string, Joint *>::iterator found = jointIndex.find(name);
+    if(found == jointIndex.end()){ continue; }
+    int joint = found->second->index;
+    if(!SetIKWeight(joint, weight)){ return false; }
+
+    string axis;
+    double lower, upper;
+    while(words >> axis)
     {
-      if(i == activeJoints[j]){ glColor3f(1., 0., 0.); }
+      if(!(words >> lower >> upper) || axis.size() != 1){ return false; }
+      if(!SetIKLimit(joint, tolower(axis[0]) - 'x', lower, upper)){ return false; }
     }
-
-    // Find the global position to draw the point
-    glPushMatrix();
-    glTranslatef(globalPositions[3 * i], globalPositions[3 * i + 1], globalPositions[3 * i + 2]);
-    gluSphere(quad, .5, 15, 15);
-    glPopMatrix();
   }
-  // get back to normal
-  glPopMatrix();
+  return true;
+}
+
+// how far the furthest of ik's joints is from its goal with data
+static double IKMiss(const Skeleton & skeleton, IKWorkspace & ik, const double * data)
+{
+  ik.Pose(skeleton, data);
 
-  // set the colour to white
-  glColor3f(1., 1., 1.);
+  double miss = 0.;
+  for(size_t i = 0; i < ik.joints.size(); i++)
+  {
+    miss = max(miss, glm::length(ik.goals[i] - glm::dvec3(ik.globalMatrices[ik.joints[i]][3])));
+  }
+  return miss;
 }
 
-void BVH::AddKeyFrame(int advance)
+// Frames don't depend on each other, so each worker takes a run of
+// them with its own workspace. Within a run each frame starts from
+// its own pose plus the correction the frame before needed, which
+// when the goals move smoothly is most of the way there, unless that
+// starts it further off than its own pose would.
+bool BVH::SolveClipIK(const vector<int> & effectors, const vector<glm::dvec3> & goals,
+                      int firstFrame, int lastFrame, double * errors)
 {
-  // put the current frame into the keyframes list
-  if (std::find(keyframes.begin(), keyframes.end(), cFrame) == keyframes.end()){ keyframes.push_back(cFrame); }
+  // the frames have to be in to be edited
+  if(IsLoading()){ return false; }
+
+  int numEffectors = effectors.size();
+  int count = lastFrame - firstFrame;
+  if(numEffectors == 0 || count <= 0 || firstFrame < 0 || lastFrame > numFrame){ return false; }
+  if(goals.size() < (size_t)count * numEffectors){ return false; }
+  for(int i = 0; i < numEffectors; i++)
+  {
+    if(effectors[i] < 0 || effectors[i] >= (int)joints.size()){ return false; }
+  }
+
+  // edits go into the real array, not the decoded frame
+  Decompress();
+  ClearClipPoses();
+  if(skeleton.numJoints != (int)joints.size()){ BuildSkeleton(); }
+
+  int numWorkers = min(NumWorkers(), count / IK_FRAMES_PER_WORKER + 1);
+  ParallelFor(count, numWorkers, [&](int first, int last, int)
+  {
+    IKWorkspace ik;
+    ik.SetSolver(ikSolverType);
+    ik.joints = effectors;
+    ik.goals.resize(numEffectors);
+    ik.BuildChain(*this);
+
+    // the chain's channels before solving and how much solving changed them
+    int numColumns = ik.channels.size();
+    vector<double> original(numColumns);
+    vector<double> correction(numColumns, 0.);
+    bool isWarm = false;
+
+    for(int i = first; i < last; i++)
+    {
+      double * data = motion + (long)(firstFrame + i) * numChannel;
+      for(int e = 0; e < numEffectors; e++){ ik.goals[e] = goals[(size_t)i * numEffectors + e]; }
+      for(int c = 0; c < numColumns; c++){ original[c] = data[ik.channels[c]]; }
 
-  // put the final frame in the keyframes list
-  if (std::find(keyframes.begin(), keyframes.end(), cFrame + advance) == keyframes.end()){ keyframes.push_back(cFrame + advance); }
+      if(isWarm)
+      {
+        double cold = IKMiss(skeleton, ik, data);
+        for(int c = 0; c < numColumns; c++){ data[ik.channels[c]] += correction[c]; }
+        if(IKMiss(skeleton, ik, data) > cold)
+        {
+          for(int c = 0; c < numColumns; c++){ data[ik.channels[c]] = original[c]; }
+        }
+      }
 
+      SolveIK(ik, data);
 
-  // find the start point of the data that needs to be changed
-  double *start = motion + (cFrame * numChannel);
+      for(int c = 0; c < numColumns; c++){ correction[c] = data[ik.channels[c]] - original[c]; }
+      isWarm = true;
+      if(errors != NULL){ errors[i] = ik.error; }
+    }
+  });
 
-  // copy the data that can be unchanged
-  double *end = motion + ((cFrame + advance) * numChannel);
+  for(int i = firstFrame; i < lastFrame; i++){ keyframes.Changed(i); }
+  return true;
+}
 
-  // find the values we want to copy every frame
-  double *kFrame = new double[numChannel];
+void BVH::AddKeyFrame(int advance)
+{
+  // frames are about to move
+  WaitForLoad();
+  Decompress();
+  if(cFrame < 0 || cFrame >= numFrame){ return; }
 
-  for(int i = 0; i < numChannel; i++)
+  // put the current frame into the keyframes list
+  if(advance <= 0)
   {
-    kFrame[i] = start[i];
+    keyframes.Add(cFrame);
+    return;
   }
 
+  // the keys only move once there is room for the frames they move with
+  if(!ReserveFrames(numFrame + advance)){ return; }
+  ClearClipPoses();
 
-  // malloc for the correct amount
-  double *newMotion = new double[numChannel * (numFrame + advance)];
-  int idx = 0; // keeps track of how much writing
+  // the frames after the current one move up to make room
+  size_t frameBytes = numChannel * sizeof(double);
+  double *key = motion + (long)cFrame * numChannel;
+  memmove(key + (long)(advance + 1) * numChannel, key + numChannel, (size_t)(numFrame - cFrame - 1) * frameBytes);
 
-  // insert values before the update
-  for(int i = 0; i < ((cFrame + 1) * numChannel); i++)
+  // and the gap is filled with copies of the keyframe
+  for(int i = 1; i <= advance; i++)
   {
-    newMotion[idx] = motion[i];
-    idx++;
+    memcpy(key + (long)i * numChannel, key, frameBytes);
   }
 
-  // repeatedly copy in the keyframe
-  for(int i = 0; i < (advance * numChannel); i++)
-  {
-    newMotion[idx] = kFrame[i % numChannel];
-    idx++;
-  }
+  // update num frames
+  numFrame += advance;
+  numFrameLoaded = numFrame;
 
-  // reinsert the values for the end frames that are unchanged
-  for(int i = ((cFrame+1) * numChannel); i < (numFrame * numChannel); i++)
-  {
-    newMotion[idx] = motion[i];
-    idx++;
-  }
+  // later keys move along with their frames, then the final frame goes in too
+  keyframes.Add(cFrame);
+  keyframes.InsertFrames(cFrame, advance);
+  keyframes.Add(cFrame + advance);
+}
+
+// Makes sure motion is our own array with room for numFrames
+// frames. It grows by half again each time it runs out, so
+// inserting frames over and over doesn't copy the clip every time.
+bool BVH::ReserveFrames(int numFrames)
+{
+  if(motion == NULL){ return false; }
+  if(motionFile == NULL && motionCapacity >= numFrames){ return true; }
 
-  // reassign and delete
-  delete[] motion;
+  int capacity = max(numFrames, motionCapacity + motionCapacity / 2);
+  double *newMotion = new double[(long)capacity * numChannel];
+  memcpy(newMotion, motion, (long)numFrame * numChannel * sizeof(double));
+
+  // also lets go of a mapped cache, edits never went back to it anyway
+  FreeMotion();
   motion = newMotion;
+  motionCapacity = capacity;
 
-  // update num frames
-  numFrame += advance;
+  // the joints were pointing at the old array
+  if(cFrame >= 0 && cFrame < numFrame)
+  {
+    for(unsigned int i = 0; i < joints.size(); i++){ joints[i]->dataStart = motion + (long)cFrame * numChannel; }
+  }
+  return true;
 }
 
 void BVH::SetKeyFrame()
 {
   // put the current frame into the keyframes list
-  if (std::find(keyframes.begin(), keyframes.end(), cFrame) == keyframes.end()){ keyframes.push_back(cFrame); }
+  keyframes.Add(cFrame);
 }
 
 
@@ -1166,73 +1252,205 @@ double BVH::Lerp(double a, double b, double c)
   return((1. - c) * a + c * b);
 }
 
-// updates all the lerps between keyframes
+// updates the lerps between keyframes, only the spans
+// that have changed since the last time are redone
 void BVH::LerpKeyframes()
 {
-  // sort all our keyframes
-  std::sort (keyframes.begin(), keyframes.end());
+  // keyframes can be anywhere in the clip
+  WaitForLoad();
+  Decompress();
+
+  // a different way of lerping changes every span
+  if(interpolation != lerpedInterpolation)
+  {
+    keyframes.SetAllDirty();
+    lerpedInterpolation = interpolation;
+  }
+
+  vector<int> spans;
+  keyframes.TakeDirtySpans(spans);
+  if(spans.empty()){ return; }
+  ClearClipPoses();
+
+  if(interpolation == INTERPOLATE_SPLINE)
+  {
+    LerpSplines(spans);
+    return;
+  }
+
+  // rotations are blended as quaternions rather than channel by channel
+  if(interpolation != INTERPOLATE_EULER)
+  {
+    if(skeleton.numJoints != (int)joints.size()){ BuildSkeleton(); }
 
-  // frame indexes into data
-  int startI;
-  int endI;
+    // each span only writes the frames between its two keys,
+    // so the spans can be shared out between threads
+    int numWorkers = min(NumWorkers(), numFrame / FRAMES_PER_WORKER + 1);
+    if((int)lerpWorkspaces.size() < numWorkers){ lerpWorkspaces.resize(numWorkers); }
+    ParallelFor((int)spans.size(), numWorkers, [&](int first, int last, int worker)
+    {
+      for(int s = first; s < last; s++)
+      {
+        int k = spans[s];
+        int span = keyframes[k + 1] - keyframes[k];
+        InterpolateFrames(skeleton, motion + (long)keyframes[k] * numChannel, motion + (long)keyframes[k + 1] * numChannel,
+                          span, motion + (long)(keyframes[k] + 1) * numChannel, interpolation, lerpWorkspaces[worker]);
+      }
+    });
+    return;
+  }
 
   // frame numbers
   int startFrame;
   int endFrame;
 
-  // contains frame data
-  double startF[numChannel];
-  double endF[numChannel];
-
   // iterate and interpolate between keyframes
-  for(int k = 0; k < keyframes.size() - 1; k++)
+  for(size_t s = 0; s < spans.size(); s++)
   {
-    // find the first and second index
-    startI = keyframes[k] * numChannel;
-    endI = keyframes[k+1] * numChannel;
+    int k = spans[s];
 
     // find start and end frame
     startFrame = keyframes[k];
     endFrame = keyframes[k+1];
 
-    startF[numChannel];
-    endF[numChannel];
-
-    // load values
-    for(int i = 0; i < numChannel; i++)
-    {
-      startF[i] = motion[startI + i];
-      endF[i] = motion[endI + i];
-    }
+    // the keys are never written, so they are read in place
+    const double *startF = motion + (long)startFrame * numChannel;
+    const double *endF = motion + (long)endFrame * numChannel;
 
     // perform lerp on data
     // how much lerp is happending
     double progress = 0.;
 
-    // for every frame we need to animate between
-    for(int i = startFrame; i < endFrame; i++)
+    // for every frame we need to animate between, the keys
+    // stay as they are so no span's order changes another's
+    for(int i = startFrame + 1; i < endFrame; i++)
     {
       progress = (double)(i - startFrame) / (double)(endFrame - startFrame);
 
       // for every channel
       for(int c = 0; c < numChannel; c++)
       {
-        motion[(i * numChannel) + c] = Lerp(startF[c], endF[c], progress);
+        motion[((long)i * numChannel) + c] = Lerp(startF[c], endF[c], progress);
       }
     }
   }
 }
 
-void BVH::SaveFile(std::string fileName)
+// Fills the dirty spans from the curves through the keys
+void BVH::LerpSplines(vector<int> & spans)
+{
+  if(splines.numChannel != numChannel){ splines.Resize(numChannel); }
+
+  // bring the curves' keys up to date, only keys that
+  // really changed lose their tangents
+  if(!splines.SameKeys(keyframes.Keys()))
+  {
+    splines.SetKeys(keyframes.Keys(), motion);
+  }
+  else
+  {
+    for(size_t s = 0; s < spans.size(); s++)
+    {
+      int k = spans[s];
+      splines.UpdateKey(k, motion + (long)keyframes[k] * numChannel);
+      splines.UpdateKey(k + 1, motion + (long)keyframes[k + 1] * numChannel);
+    }
+  }
+
+  // a key's tangents reach one span further each way than a lerp does
+  int numSpans = keyframes.Count() - 1;
+  vector<unsigned char> redo(numSpans, 0);
+  for(size_t s = 0; s < spans.size(); s++)
+  {
+    for(int k = max(spans[s] - 1, 0); k <= min(spans[s] + 1, numSpans - 1); k++){ redo[k] = 1; }
+  }
+  spans.clear();
+  for(int k = 0; k < numSpans; k++)
+  {
+    if(redo[k]){ spans.push_back(k); }
+  }
+
+  // tangents first, the spans only read them
+  splines.UpdateTangents();
+
+  int numWorkers = min(NumWorkers(), numFrame / FRAMES_PER_WORKER + 1);
+  ParallelFor((int)spans.size(), numWorkers, [&](int first, int last, int)
+  {
+    for(int s = first; s < last; s++)
+    {
+      int k = spans[s];
+      for(int f = keyframes[k] + 1; f < keyframes[k + 1]; f++)
+      {
+        splines.EvaluateSpan(k, f, motion + (long)f * numChannel);
+      }
+    }
+  });
+}
+
+void BVH::SetCurve(int channel, int curve)
+{
+  if(splines.numChannel != numChannel){ splines.Resize(numChannel); }
+  if(splines.SetCurve(channel, curve) && interpolation == INTERPOLATE_SPLINE){ keyframes.SetAllDirty(); }
+}
+
+void BVH::SetCurves(int curve)
+{
+  for(int c = 0; c < numChannel; c++){ SetCurve(c, curve); }
+}
+
+void BVH::SetTCB(int channel, double tension, double continuity, double bias)
+{
+  if(splines.numChannel != numChannel){ splines.Resize(numChannel); }
+  if(splines.SetTCB(channel, tension, continuity, bias) && interpolation == INTERPOLATE_SPLINE){ keyframes.SetAllDirty(); }
+}
+
+// Changes the frame rate, each new frame is a lerp of the two old
+// frames either side of it, the clip keeps the same duration
+bool BVH::Resample(double newInterval)
 {
-  ofstream  file;
-  file.open(fileName);
+  WaitForLoad();
+  Decompress();
+  if(!isLoadSuccess || numFrame < 1 || interval <= 0. || newInterval <= 0.){ return false; }
+
+  // the last frame is kept wherever it lands
+  double duration = (numFrame - 1) * interval;
+  int newNumFrame = (int)floor(duration / newInterval + 1e-6) + 1;
+  double *newMotion = new double[(long)newNumFrame * numChannel];
+
+  for(int i = 0; i < newNumFrame; i++)
+  {
+    // position in old frames
+    double t = i * newInterval / interval;
+    int before = min((int)t, numFrame - 1);
+    int after = min(before + 1, numFrame - 1);
+    double progress = t - before;
+
+    double *startF = motion + (long)before * numChannel;
+    double *endF = motion + (long)after * numChannel;
+    double *thisF = newMotion + (long)i * numChannel;
+    for(int c = 0; c < numChannel; c++)
+    {
+      thisF[c] = Lerp(startF[c], endF[c], progress);
+    }
+  }
 
-  for(int i = 0; i < (numFrame * numChannel); i++)
+  // keyframes stay at the same time
+  vector<int> oldKeys = keyframes.Keys();
+  keyframes.Clear();
+  for(size_t k = 0; k < oldKeys.size(); k++)
   {
-    if(i > 0 && i % numChannel == 0){ file << "\n"; }
-    file << to_string(motion[i]);
-    file << " ";
+    keyframes.Add(min((int)floor(oldKeys[k] * interval / newInterval + 0.5), newNumFrame - 1));
   }
-  std::cout << "Saved File" << '\n';
+
+  FreeMotion();
+  motion = newMotion;
+  motionCapacity = newNumFrame;
+  numFrame = newNumFrame;
+  numFrameLoaded = newNumFrame;
+  interval = newInterval;
+  if(cFrame >= numFrame){ cFrame = numFrame - 1; }
+
+  // the joints were pointing at the old array
+  for(unsigned int i = 0; i < joints.size(); i++){ joints[i]->dataStart = motion + (long)cFrame * numChannel; }
+  return true;
 }
@@ -20,21 +20,23 @@ using namespace std;
 #include <map>
 #include <string>
 #include <iomanip>
+#include <thread>
+#include <atomic>
 #include "Cartesian3.h"
-#include "camera.h"
+#include "Skeleton.h"
+#include "KeyframeTrack.h"
+#include "KeyframeSplines.h"
+#include "IKSolver.h"
+#include "Pose.h"
 #include "glm.hpp"
+#include "gtc/matrix_transform.hpp"
 #include "gtc/type_ptr.hpp"
+#include "gtc/quaternion.hpp"
 #include <Eigen/Core>
-#include <Eigen/LU>
-
-// openGL includes
-#ifdef __APPLE__
-#include <OpenGL/gl.h>
-#include <OpenGL/glu.h>
-#else
-#include <GL/gl.h>
-#include <GL/glu.h>
-#endif
+#include <Eigen/Cholesky>
+
+class MappedFile;
+struct CompressedMotion;
 
 class BVH
 {
@@ -52,7 +54,19 @@ public:
 
     void Load( const char * bvhFileName );
 
-    // Used at setup to find a bounding box
+    // binary .bvhb cache kept next to the .bvh file
+    static string CacheFileName( const char * bvhFileName );
+    static bool IsCacheFresh( const char * bvhFileName, const char * cacheFileName );
+    bool LoadCache( const char * cacheFileName );
+    bool SaveCache( const char * cacheFileName );
+
+    // streaming loads keep parsing frames after Load returns
+    int FramesLoaded() const;
+    bool IsLoading() const;
+    void WaitForLoad();
+
+    // Used at setup to find a bounding box around the
+    // whole body over every frame loaded so far
     void FindMinMax();
 
 
@@ -108,11 +122,17 @@ public:
     vector< Channel * > channels;
     // used for calculating the global position
     glm::mat4 localMatrix;
+    // parent's globalMatrix * localMatrix, in the skeleton's own space
+    glm::mat4 globalMatrix;
     // where the data starts for position editing
     double *dataStart;
 
   };
 
+  // used by the loaders to build the skeleton
+  Joint * AddJoint( Joint * parent, const string & name );
+  Channel * AddChannel( Joint * joint, ChannelEnum type );
+
 public:
   // all our public variables and funcitons
   // that our GUI and users can call
@@ -130,6 +150,29 @@ public:
   vector < Joint * > joints;
   map< string, Joint *> jointIndex;
 
+  // joints and channels above flattened into arrays, what forward
+  // kinematics actually runs on. joints[i] is skeleton joint i.
+  Skeleton skeleton;
+  void BuildSkeleton();
+
+  // every joint's matrices from the last ForwardKinematics,
+  // also copied into each Joint for code that walks the tree
+  vector<glm::mat4> localMatrices;
+  vector<glm::mat4> globalMatrices;
+
+  // Where every joint is and which way it faces on every frame,
+  // [frame][joint] one after another. Filled by ComputeClipPoses
+  // and emptied whenever the motion changes.
+  vector<glm::vec3> clipPositions;
+  vector<glm::quat> clipOrientations;
+  int clipPoseFrames;       // frames they cover
+  bool ComputeClipPoses();
+  void ClearClipPoses();
+
+  // Forward kinematics for frames [firstFrame, lastFrame) on every
+  // core, writing numJoints entries per frame. orientations can be NULL.
+  void ClipPoses( int firstFrame, int lastFrame, glm::vec3 * positions, glm::quat * orientations );
+
   // Over the whole animation,
   // how the ROOT node moves
   Cartesian3 minCoords;
@@ -152,11 +195,106 @@ public:
   int cFrame;
   double interval;
   double * motion;
-  std::vector<int> keyframes;
+  int motionCapacity;   // frames motion has room for, 0 if it isn't ours to grow
+  KeyframeTrack keyframes;
+
+  // the curves INTERPOLATE_SPLINE lerps with, they hold
+  // their own copy of the keys so any frame can be found
+  // from them without the frames in between
+  KeyframeSplines splines;
+
+  // set when motion points into a mapped .bvhb file rather
+  // than an array of our own. The mapping is read only, so
+  // Decompress copies it into an array before any edit.
+  MappedFile * motionFile;
+  void FreeMotion();
+
+  // optional 16 bit copy of the motion, see CompressedMotion.h.
+  // While compressed, motion is NULL and frames are decoded one
+  // at a time into frameBuffer, anything that edits the clip
+  // calls Decompress first
+  CompressedMotion * compressedMotion;
+  vector<double> frameBuffer;
+  int frameBufferFrame;       // which frame frameBuffer holds
+  bool Compress();
+  void Decompress();
+  bool IsCompressed() const;
+  size_t MotionBytes() const;
+
+  // start of a frame's numChannel values, compressed or not
+  double * FrameData( int frame );
+  const double * ThreadFrameData( int frame, vector<double> & buffer ) const;
+
+  // read and write the .bvhb cache when loading, off unless asked for
+  // as it is written next to the .bvh. Only its header and hierarchy
+  // are checked unless verifyMotionCache, which reads every frame to
+  // check the motion as well.
+  bool useMotionCache;
+  bool verifyMotionCache;
+
+  // for long files, Load returns once the first frames are in
+  // and the rest are parsed on a background thread
+  bool useStreaming;
+  std::atomic<int> numFrameLoaded;
+  std::atomic<bool> cancelLoad;
+  std::atomic<bool> isStreaming;
+  std::atomic<bool> isStreamShort;   // the file ran out before Frames: said, WaitForLoad fails the load
+  std::thread loaderThread;
+  MappedFile * sourceFile;   // kept mapped until streaming finishes
+  void StreamMotion( const char * p, const char * end, string cacheFileName );
 
   // for saving loading
   std::string fileContents;
 
+  // decimal places written by SaveFile, -1 keeps
+  // every digit so the file reads back exactly
+  int savePrecision;
+
+  // KeyInterpolation LerpKeyframes uses, see Pose.h,
+  // and the one the clean spans were last lerped with
+  int interpolation;
+  int lerpedInterpolation;
+
+  // one for each thread LerpKeyframes shares the spans out to,
+  // kept so relerping while dragging doesn't allocate
+  vector<InterpolationWorkspace> lerpWorkspaces;
+
+  // what MoveJoint and SolveClipIK step with, an IKSolverType.
+  // Dampening and control only apply to IK_JACOBIAN.
+  int ikSolverType;
+  void SetIKSolver(int type);
+
+  // IK keeps stepping until the moved joints are within
+  // ikTolerance of their goals, it has taken ikMaxIterations
+  // steps, or ikTimeBudget microseconds have gone (0 for no
+  // limit), each frame. One iteration is the old single step.
+  int ikMaxIterations;
+  double ikTolerance;
+  int ikTimeBudget;
+
+  // How readily the root's position moves for the Jacobian, as a
+  // weight like IKLimits. At 0 the body only shifts when the root
+  // itself is dragged, with a weight of 1. CCD and FABRIK only
+  // ever move the root when it is the one dragged.
+  double ikTranslationWeight;
+
+  // every joint's IKLimits, free until set. No step takes a channel
+  // past its limits. With the Jacobian joints with more weight do more
+  // of the turning, CCD turns joints under 1 part of the way, and
+  // FABRIK only holds joints with no weight still.
+  vector<IKLimits> ikLimits;
+  bool SetIKLimit(int joint, int axis, double lower, double upper);
+  bool SetIKWeight(int joint, double weight);
+
+  // Reads a table of limits, one joint a line, as
+  //   <joint> <weight> [<x|y|z> <lower> <upper>]...
+  // with # starting a comment. Joints this skeleton doesn't have are
+  // skipped, so one table can serve several skeletons.
+  bool LoadIKLimits(const char * fileName);
+
+  // MoveJoint's workspace, which also says how the last drag went
+  IKWorkspace ik;
+
   // dampening
   bool useDampening;
   float lambda;
@@ -168,16 +306,24 @@ public:
 
 public:
 
-  // calculates the new global positions at every frame
-  void FindGlobalPosition(Joint *joint, Camera *camera);
+  // Forward kinematics on the CPU, no GL needed. Fills every
+  // joint's localMatrix and globalMatrix from one frame of data,
+  // then globalPositions from those
+  void ForwardKinematics(const double * data);
+  void ForwardKinematics(int frameNo);
+
+  // where paintGL moves the skeleton to keep it in view,
+  // globalPositions include this and the matrices don't
+  glm::vec3 SceneOffset() const;
 
-  // Rendering Functions
+  // Rendering Functions, these live in BVHRender.cpp
+  // so tools without a display don't need GL
 
-  // Initial Call For Rendering a Figure
-  void RenderFigure(int frameNo, float scale, Camera *camera);
+  // Runs forward kinematics for the frame and draws every joint
+  void RenderFigure(int frameNo, float scale);
 
-  // Render Figure Function Made to be called Recursively
-	void  RenderFigure(Joint * root, double * data, float scale, Camera *camera);
+  // Draws the bones leaving one joint, with its globalMatrix applied
+  void RenderJoint(Joint * joint, float scale);
 
   // Expect a lot of calls to this one
   void RenderBone(float x0, float y0, float z0, float x1, float y1, float z1, float bRadius = 0.1 );
@@ -188,12 +334,24 @@ public:
 
   // moves a specific joint with inverse kinematics
   void MoveJoint(glm::vec3 move);
-
-  // saves the animation
-  void SaveFile(std::string fileName);
-
-  // adds a new key frame that can be interpolated between
+  void SolveIK(IKWorkspace & ik, double *data) const;
+
+  // IK on every frame of [firstFrame, lastFrame), moving effectors[i]
+  // to goals[(frame - firstFrame) * effectors.size() + i], in the
+  // skeleton's own space like globalMatrices. Runs of frames are
+  // solved on every core, each frame starting from the correction
+  // the frame before it needed. errors, if not NULL, gets how far off
+  // each frame ended up.
+  bool SolveClipIK(const vector<int> & effectors, const vector<glm::dvec3> & goals,
+                   int firstFrame, int lastFrame, double * errors);
+
+  // saves the hierarchy and animation as a .bvh, see BVHWriter.cpp
+  bool SaveFile(std::string fileName);
+
+  // adds a new key frame that can be interpolated between,
+  // advance copies of the current frame go in after it
   void AddKeyFrame(int advance);
+  bool ReserveFrames(int numFrames);
 
   // makes the current frame a keyframe
   void SetKeyFrame();
@@ -201,8 +359,17 @@ public:
   // simple lerp between two floats
   double Lerp(double a, double b, double c);
 
-  // updates all the lerps between keyframes
+  // updates the lerps between keyframes that have changed, using interpolation
   void LerpKeyframes();
+  void LerpSplines(vector<int> & spans);
+
+  // the CurveType one channel, or every channel, follows with INTERPOLATE_SPLINE
+  void SetCurve(int channel, int curve);
+  void SetCurves(int curve);
+  void SetTCB(int channel, double tension, double continuity, double bias);
+
+  // changes the frame rate, lerping between the old frames
+  bool Resample(double newInterval);
 
 };
 
@@ -0,0 +1,216 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	BVHRender.cpp
+//	------------------------
+//
+//	The OpenGL half of the BVH class, kept apart so
+//	the loading and editing code builds without GL
+//
+///////////////////////////////////////////////////
+
+#include <math.h>
+#include "BVH.h"
+
+// openGL includes
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <OpenGL/glu.h>
+#else
+#include <GL/gl.h>
+#include <GL/glu.h>
+#endif
+
+////////////////////////////////////////////////
+// RENDERING FUNCTIONS
+////////////////////////////////////////////////
+
+
+// Forward kinematics works out every joint's matrix on the CPU,
+// so each joint is drawn with one glMultMatrixf rather than building
+// up the GL matrix stack and reading it back per joint
+void  BVH::RenderFigure( int frameNo, float scale )
+{
+  // save the current frame
+  cFrame = frameNo;
+  if ( joints.empty() || frameNo < 0 || frameNo >= FramesLoaded() )  return;
+
+	// Calculate poistion into array to start based on frame
+	ForwardKinematics( frameNo );
+
+	for ( unsigned int i = 0; i < joints.size(); i++ )
+		RenderJoint( joints[ i ], scale );
+}
+
+
+// Going to be using a lot of
+// https://www.youtube.com/watch?v=vCadcBR95oU
+void  BVH::RenderJoint(Joint * joint, float scale)
+{
+	glPushMatrix();
+
+  // scale only stretches the translations, as it always has
+  glm::mat4 model = joint->globalMatrix;
+  model[3] = glm::vec4(glm::vec3(model[3]) * scale, 1.);
+  glMultMatrixf( glm::value_ptr( model ) );
+
+  unsigned int  i;
+
+  // we are at the end, so use SITE data
+	if ( joint->children.size() == 0 )
+	{
+		RenderBone(0.0f, 0.0f, 0.0f, joint->site[ 0 ] * scale, joint->site[ 1 ] * scale, joint->site[ 2 ] * scale );
+	}
+	// We are going to a child, so draw to there
+	if ( joint->children.size() == 1 )
+	{
+		Joint *  child = joint->children[ 0 ];
+		RenderBone(0.0f, 0.0f, 0.0f, child->offset[ 0 ] * scale, child->offset[ 1 ] * scale, child->offset[ 2 ] * scale );
+	}
+	// else, draw to midpoint
+	if ( joint->children.size() > 1 )
+	{
+		// calculate the center of your kids
+		float  center[ 3 ] = { 0.0f, 0.0f, 0.0f };
+		for ( i = 0; i < joint->children.size(); i++ )
+		{
+			Joint *  child = joint->children[ i ];
+			center[ 0 ] += child->offset[ 0 ];
+			center[ 1 ] += child->offset[ 1 ];
+			center[ 2 ] += child->offset[ 2 ];
+		}
+		center[ 0 ] /= joint->children.size() + 1;
+		center[ 1 ] /= joint->children.size() + 1;
+		center[ 2 ] /= joint->children.size() + 1;
+
+		// Put this bone at the center of your kids
+		RenderBone(0.0f, 0.0f, 0.0f, center[ 0 ] * scale, center[ 1 ] * scale, center[ 2 ] * scale );
+
+		// Render the Bones of all your children
+		for ( i = 0; i < joint->children.size(); i++ )
+		{
+			Joint *  child = joint->children[ i ];
+			RenderBone(center[ 0 ] * scale, center[ 1 ] * scale, center[ 2 ] * scale,
+				child->offset[ 0 ] * scale, child->offset[ 1 ] * scale, child->offset[ 2 ] * scale );
+		}
+	}
+
+	glPopMatrix();
+}
+
+
+// Renders a single bone (Happends a lot)
+// returns the local rotation matrix
+void BVH::RenderBone(float x0, float y0, float z0, float x1, float y1, float z1, float bRadius )
+{
+
+	// Calculate a from -> to vector
+	GLdouble  dir_x = x1 - x0;
+	GLdouble  dir_y = y1 - y0;
+	GLdouble  dir_z = z1 - z0;
+	GLdouble  bone_length = sqrt( dir_x*dir_x + dir_y*dir_y + dir_z*dir_z );
+
+	// Uses GLU for rendering
+	static GLUquadricObj *  quad_obj = NULL;
+	if ( quad_obj == NULL )
+		quad_obj = gluNewQuadric();
+	gluQuadricDrawStyle( quad_obj, GLU_FILL );
+	gluQuadricNormals( quad_obj, GLU_SMOOTH );
+
+	glPushMatrix();
+
+	// translate to start
+	glTranslated( x0, y0, z0 );
+
+	// if bone is too short, do this to avoid
+  // wierd rendering errors
+	double  length;
+	length = sqrt( dir_x*dir_x + dir_y*dir_y + dir_z*dir_z );
+	if ( length < 0.0001 ) {
+		dir_x = 0.0; dir_y = 0.0; dir_z = 1.0;  length = 1.0;
+	}
+	dir_x /= length;  dir_y /= length;  dir_z /= length;
+
+	// for calculating normals
+	GLdouble  up_x, up_y, up_z;
+	up_x = 0.0;
+	up_y = 1.0;
+	up_z = 0.0;
+
+	// for calculating local rotation matrix
+	double  side_x, side_y, side_z;
+	side_x = up_y * dir_z - up_z * dir_y;
+	side_y = up_z * dir_x - up_x * dir_z;
+	side_z = up_x * dir_y - up_y * dir_x;
+
+  // if bone is too short, do this to avoid
+  // wierd rendering errors
+	length = sqrt( side_x*side_x + side_y*side_y + side_z*side_z );
+	if ( length < 0.0001 ) {
+		side_x = 1.0; side_y = 0.0; side_z = 0.0;  length = 1.0;
+	}
+	side_x /= length;  side_y /= length;  side_z /= length;
+
+  // cross product to calculate up
+	up_x = dir_y * side_z - dir_z * side_y;
+	up_y = dir_z * side_x - dir_x * side_z;
+	up_z = dir_x * side_y - dir_y * side_x;
+
+	// local rotation matrix
+	GLdouble  m[16] = { side_x, side_y, side_z, 0.0,
+      	                    up_x,   up_y,   up_z,   0.0,
+      	                    dir_x,  dir_y,  dir_z,  0.0,
+      	                    0.0,    0.0,    0.0,    1.0 };
+
+	glMultMatrixd( m );
+
+	//
+	GLdouble radius= bRadius; // defined in class
+	GLdouble slices = 16.0;    // resolution of cyclinder
+	GLdouble stack = 16.0;     // z subdivisions
+
+	// with all our new found info, render a gluCylinder
+	gluCylinder( quad_obj, radius, radius, bone_length, slices, stack );
+
+	glPopMatrix();
+}
+
+// Renders the points where a user can click
+void BVH::RenderControlPoints()
+{
+  GLUquadric *quad;
+  quad = gluNewQuadric();
+
+  // check if we are on a keyframe, if so draw points green
+  bool isKeyframe = keyframes.Contains(cFrame);
+
+  // save current state and load identity
+  glPushMatrix();
+  //glLoadIdentity();
+  for(int i = 0; i < (globalPositions.size() / 3); i++)
+  {
+    // change the colour of the joint to be green if keyframe
+    if(isKeyframe){ glColor3f(0., 0.6, 0.); }
+    else          { glColor3f(0. , 0. , .6); }
+
+    // change the colour to blue if being clicked on
+    for(int j = 0; j < activeJoints.size(); j ++)
+    {
+      if(i == activeJoints[j]){ glColor3f(1., 0., 0.); }
+    }
+
+    // Find the global position to draw the point
+    glPushMatrix();
+    glTranslatef(globalPositions[3 * i], globalPositions[3 * i + 1], globalPositions[3 * i + 2]);
+    gluSphere(quad, .5, 15, 15);
+    glPopMatrix();
+  }
+  // get back to normal
+  glPopMatrix();
+
+  // set the colour to white
+  glColor3f(1., 1., 1.);
+}
@@ -0,0 +1,214 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	BVHWriter.cpp
+//	------------------------
+//
+//	Writes the skeleton and motion back out as a
+//	complete .bvh that Load can read again
+//
+///////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "BVH.h"
+#include "FastFloat.h"
+
+// text is gathered in blocks this big before each fwrite
+#define OUTPUT_BUFFER_BYTES  (4 * 1024 * 1024)
+
+// same order as ChannelEnum
+static const char * channelNames[] =
+{
+  "Xrotation", "Yrotation", "Zrotation",
+  "Xposition", "Yposition", "Zposition"
+};
+
+// Collects the text in one big block and only calls fwrite when
+// it fills, rather than going through a stream a number at a time
+class OutputBuffer
+{
+public:
+  OutputBuffer(FILE * file)
+  {
+    this->file = file;
+    buffer.resize(OUTPUT_BUFFER_BYTES);
+    used = 0;
+    failed = false;
+  }
+
+  // makes room for at least n more bytes and returns where they go
+  char * Reserve(size_t n)
+  {
+    if(used + n > buffer.size())
+    {
+      Flush();
+      if(n > buffer.size()){ buffer.resize(n); }
+    }
+    return buffer.data() + used;
+  }
+
+  // everything up to end has been written
+  void Commit(char * end)
+  {
+    used = end - buffer.data();
+  }
+
+  void Put(const char * text, size_t length)
+  {
+    char * out = Reserve(length);
+    memcpy(out, text, length);
+    Commit(out + length);
+  }
+
+  void Put(const char * text)
+  {
+    Put(text, strlen(text));
+  }
+
+  void Put(const string & text)
+  {
+    Put(text.data(), text.size());
+  }
+
+  void PutDouble(double value, int precision)
+  {
+    char * out = Reserve(MAX_DOUBLE_CHARS);
+    Commit(FormatDouble(out, value, precision));
+  }
+
+  void Flush()
+  {
+    if(used > 0 && fwrite(buffer.data(), 1, used, file) != used){ failed = true; }
+    used = 0;
+  }
+
+  bool failed;
+
+private:
+  FILE * file;
+  vector<char> buffer;
+  size_t used;
+};
+
+static void PutIndent(OutputBuffer & out, int depth)
+{
+  for(int i = 0; i < depth; i++){ out.Put("\t", 1); }
+}
+
+// OFFSET x y z, always at full precision as there are only a few
+static void PutOffset(OutputBuffer & out, const double * offset, int depth)
+{
+  PutIndent(out, depth);
+  out.Put("OFFSET");
+  for(int i = 0; i < 3; i++)
+  {
+    out.Put(" ", 1);
+    out.PutDouble(offset[i], SHORTEST_PRECISION);
+  }
+  out.Put("\n", 1);
+}
+
+// Writes a joint and everything below it, in the same order Load
+// reads them so the channels line up with the motion columns
+static void PutJoint(OutputBuffer & out, BVH::Joint * joint, int depth)
+{
+  PutIndent(out, depth);
+  out.Put(joint->parent == NULL ? "ROOT " : "JOINT ");
+  out.Put(joint->name);
+  out.Put("\n", 1);
+  PutIndent(out, depth);
+  out.Put("{\n");
+
+  PutOffset(out, joint->offset, depth + 1);
+
+  if(!joint->channels.empty())
+  {
+    PutIndent(out, depth + 1);
+    out.Put("CHANNELS ");
+    char * p = out.Reserve(MAX_DOUBLE_CHARS);
+    out.Commit(FormatDouble(p, joint->channels.size(), 0));
+    for(size_t i = 0; i < joint->channels.size(); i++)
+    {
+      out.Put(" ", 1);
+      out.Put(channelNames[joint->channels[i]->type]);
+    }
+    out.Put("\n", 1);
+  }
+
+  for(size_t i = 0; i < joint->children.size(); i++)
+  {
+    PutJoint(out, joint->children[i], depth + 1);
+  }
+
+  if(joint->hasSite)
+  {
+    PutIndent(out, depth + 1);
+    out.Put("End Site\n");
+    PutIndent(out, depth + 1);
+    out.Put("{\n");
+    PutOffset(out, joint->site, depth + 2);
+    PutIndent(out, depth + 1);
+    out.Put("}\n");
+  }
+
+  PutIndent(out, depth);
+  out.Put("}\n");
+}
+
+// saves the animation
+bool BVH::SaveFile(std::string fileName)
+{
+  // save every frame, not just the ones loaded so far
+  WaitForLoad();
+
+  FILE * file = fopen(fileName.c_str(), "wb");
+  if(file == NULL)
+  {
+    std::cerr << fileName << ": could not be opened for writing" << '\n';
+    return false;
+  }
+
+  OutputBuffer out(file);
+
+  // rebuilt from the joints, so added or renamed
+  // joints are saved rather than the original text
+  out.Put("HIERARCHY\n");
+  for(size_t i = 0; i < joints.size(); i++)
+  {
+    if(joints[i]->parent == NULL){ PutJoint(out, joints[i], 0); }
+  }
+
+  out.Put("MOTION\nFrames: ");
+  char * p = out.Reserve(MAX_DOUBLE_CHARS);
+  out.Commit(FormatDouble(p, numFrame, 0));
+  out.Put("\nFrame Time: ");
+  out.PutDouble(interval, SHORTEST_PRECISION);
+  out.Put("\n", 1);
+
+  // one line per frame, formatted straight into the buffer
+  for(int i = 0; i < numFrame; i++)
+  {
+    const double * frame = FrameData(i);
+    char * line = out.Reserve((size_t)numChannel * (MAX_DOUBLE_CHARS + 1) + 1);
+    char * end = line;
+    for(int j = 0; j < numChannel; j++)
+    {
+      if(j > 0){ *end++ = ' '; }
+      end = FormatDouble(end, frame[j], savePrecision);
+    }
+    *end++ = '\n';
+    out.Commit(end);
+  }
+
+  out.Flush();
+  bool success = !out.failed;
+  if(fclose(file) != 0){ success = false; }
+
+  if(!success){ std::cerr << fileName << ": could not be saved" << '\n'; }
+  return success;
+}
@@ -0,0 +1,920 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	Benchmark.cpp
+//	------------------------
+//
+//	Timings for the slow parts of loading and posing,
+//	and checks that the fast versions still give what
+//	the slow ones do, run from the command line rather
+//	than the GUI
+//
+///////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cfloat>
+#include <climits>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Benchmark.h"
+#include "BVH.h"
+#include "MappedFile.h"
+#include "MotionParser.h"
+#include "FastFloat.h"
+#include "Pose.h"
+#include "gtc/matrix_transform.hpp"
+
+// how many times each parser runs, the best time is kept
+#define BENCHMARK_REPEATS 10
+
+// frames of each clip IK is tried on, every end joint is dragged on each
+#define IK_BENCHMARK_FRAMES 16
+
+// degrees each channel above an end joint is turned by at most to
+// find somewhere for it to go, so every goal can be reached
+#define IK_BENCHMARK_TURN 20.
+
+// seconds since some fixed point
+static double Now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The way BVH::Load used to read frames, copying each line
+// into a 4 KB buffer and splitting it with strtok and atof
+static int LegacyParseMotion(const char * begin, const char * end, double * motion, int numFrame, int numChannel)
+{
+  char line[1024 * 4];
+  char separater[] = " :,\t";
+  const char * p = begin;
+
+  for(int i = 0; i < numFrame; i++)
+  {
+    if(p >= end){ return i; }
+    const char * newline = (const char *)memchr(p, '\n', end - p);
+    if(newline == NULL){ newline = end; }
+
+    size_t length = newline - p;
+    if(length >= sizeof(line)){ length = sizeof(line) - 1; }
+    memcpy(line, p, length);
+    line[length] = '\0';
+    p = newline + 1;
+
+    char * token = strtok(line, separater);
+    for(int j = 0; j < numChannel; j++)
+    {
+      if(token == NULL){ return -1; }
+      motion[i * numChannel + j] = atof(token);
+      token = strtok(NULL, separater);
+    }
+  }
+  return numFrame;
+}
+
+// finds the first frame line, just after "Frame Time:"
+static const char * FindMotionData(const char * data, size_t size)
+{
+  const char * end = data + size;
+  const char * p = data;
+  while(p < end)
+  {
+    const char * newline = (const char *)memchr(p, '\n', end - p);
+    if(newline == NULL){ return NULL; }
+    if(end - p > 10 && strncmp(p, "Frame Time", 10) == 0){ return newline + 1; }
+    p = newline + 1;
+  }
+  return NULL;
+}
+
+int BenchmarkMotionParsing(int numFiles, char ** files, int numChunks)
+{
+  double totalBytes = 0.;
+  double totalLegacy = 0.;
+  double totalFast = 0.;
+  double totalParallel = 0.;
+
+  if(numChunks > 0){ printf("parallel parsing in %d chunks\n", numChunks); }
+  printf("%-40s %10s %14s %14s %14s %8s %10s\n", "file", "MB", "strtok MB/s", "fast MB/s", "parallel MB/s", "speedup", "max diff");
+
+  for(int f = 0; f < numFiles; f++)
+  {
+    // the loader gives us the frame and channel counts
+    BVH bvh(files[f]);
+    MappedFile file;
+    if(!bvh.isLoadSuccess || !file.Open(files[f]))
+    {
+      printf("%-40s could not be loaded\n", files[f]);
+      continue;
+    }
+
+    const char * begin = FindMotionData(file.data, file.size);
+    const char * end = file.data + file.size;
+    if(begin == NULL){ continue; }
+
+    int numFrame = bvh.numFrame;
+    int numChannel = bvh.numChannel;
+    std::vector<double> legacy((long)numFrame * numChannel);
+    std::vector<double> fast((long)numFrame * numChannel);
+    std::vector<double> parallel((long)numFrame * numChannel);
+
+    double bestLegacy = 1e30;
+    double bestFast = 1e30;
+    double bestParallel = 1e30;
+    for(int r = 0; r < BENCHMARK_REPEATS; r++)
+    {
+      double start = Now();
+      LegacyParseMotion(begin, end, legacy.data(), numFrame, numChannel);
+      double middle = Now();
+      ParseMotion(begin, end, fast.data(), numFrame, numChannel);
+      double stop = Now();
+      if(numChunks > 0){ ParseMotionParallel(begin, end, parallel.data(), numFrame, numChannel, numChunks); }
+      else             { ParseMotionParallel(begin, end, parallel.data(), numFrame, numChannel); }
+      double last = Now();
+
+      if(middle - start < bestLegacy){ bestLegacy = middle - start; }
+      if(stop - middle < bestFast)   { bestFast = stop - middle; }
+      if(last - stop < bestParallel) { bestParallel = last - stop; }
+    }
+
+    // both parsers should agree on every value
+    double maxDiff = 0.;
+    for(size_t i = 0; i < fast.size(); i++)
+    {
+      maxDiff = std::max(maxDiff, fabs(fast[i] - legacy[i]));
+      maxDiff = std::max(maxDiff, fabs(parallel[i] - legacy[i]));
+    }
+
+    double megabytes = (end - begin) / (1024. * 1024.);
+    totalBytes += megabytes;
+    totalLegacy += bestLegacy;
+    totalFast += bestFast;
+    totalParallel += bestParallel;
+
+    printf("%-40s %10.3f %14.1f %14.1f %14.1f %7.2fx %10.3g\n", files[f], megabytes,
+           megabytes / bestLegacy, megabytes / bestFast, megabytes / bestParallel,
+           bestLegacy / std::min(bestFast, bestParallel), maxDiff);
+  }
+
+  if(totalFast > 0.)
+  {
+    printf("%-40s %10.3f %14.1f %14.1f %14.1f %7.2fx\n", "total", totalBytes,
+           totalBytes / totalLegacy, totalBytes / totalFast, totalBytes / totalParallel,
+           totalLegacy / std::min(totalFast, totalParallel));
+  }
+  return 0;
+}
+
+// The way Skeleton::ForwardKinematics used to pose a frame, building
+// each local matrix from glm::translate and a glm::rotate per channel
+static void LegacyForwardKinematics(const Skeleton & skeleton, const double * frame, glm::mat4 * local, glm::mat4 * global)
+{
+  static const glm::vec3 axes[3] =
+  {
+    glm::vec3(1., 0., 0.), glm::vec3(0., 1., 0.), glm::vec3(0., 0., 1.)
+  };
+
+  for(int j = 0; j < skeleton.numJoints; j++)
+  {
+    glm::vec3 translation = skeleton.offset[j];
+    if(skeleton.usesPosition[j])
+    {
+      for(int a = 0; a < 3; a++)
+      {
+        int position = skeleton.positionChannel[3 * j + a];
+        if(position >= 0){ translation[a] = frame[position]; }
+      }
+    }
+    glm::mat4 m = glm::translate(glm::mat4(1.), translation);
+
+    for(int r = 0; r < skeleton.rotationCount[j]; r++)
+    {
+      double angle = frame[skeleton.rotationChannel[3 * j + r]];
+      m = glm::rotate(m, (float)glm::radians(angle), axes[skeleton.rotationAxis[3 * j + r]]);
+    }
+
+    local[j] = m;
+    global[j] = skeleton.parent[j] < 0 ? m : global[skeleton.parent[j]] * m;
+  }
+}
+
+int BenchmarkForwardKinematics(int numFiles, char ** files)
+{
+  double totalJoints = 0.;
+  double totalLegacy = 0.;
+  double totalFast = 0.;
+
+  printf("%-40s %8s %8s %16s %16s %8s %10s\n", "file", "joints", "frames", "glm joints/s", "fast joints/s", "speedup", "max diff");
+
+  for(int f = 0; f < numFiles; f++)
+  {
+    BVH bvh;
+    bvh.useStreaming = false;
+    bvh.Load(files[f]);
+    if(!bvh.isLoadSuccess || bvh.numFrame < 1)
+    {
+      printf("%-40s could not be loaded\n", files[f]);
+      continue;
+    }
+
+    const Skeleton & skeleton = bvh.skeleton;
+    int numJoints = skeleton.numJoints;
+    std::vector<glm::mat4> local(numJoints);
+    std::vector<glm::mat4> legacy((long)bvh.numFrame * numJoints);
+    std::vector<glm::mat4> fast((long)bvh.numFrame * numJoints);
+
+    double bestLegacy = 1e30;
+    double bestFast = 1e30;
+    for(int r = 0; r < BENCHMARK_REPEATS; r++)
+    {
+      double start = Now();
+      for(int i = 0; i < bvh.numFrame; i++)
+      {
+        LegacyForwardKinematics(skeleton, bvh.FrameData(i), local.data(), &legacy[(long)i * numJoints]);
+      }
+      double middle = Now();
+      for(int i = 0; i < bvh.numFrame; i++)
+      {
+        skeleton.ForwardKinematics(bvh.FrameData(i), local.data(), &fast[(long)i * numJoints]);
+      }
+      double stop = Now();
+
+      if(middle - start < bestLegacy){ bestLegacy = middle - start; }
+      if(stop - middle < bestFast)   { bestFast = stop - middle; }
+    }
+
+    // both should put every joint in the same place
+    double maxDiff = 0.;
+    for(size_t i = 0; i < fast.size(); i++)
+    {
+      for(int c = 0; c < 4; c++)
+      {
+        glm::vec4 diff = glm::abs(fast[i][c] - legacy[i][c]);
+        maxDiff = std::max(maxDiff, (double)std::max(std::max(diff.x, diff.y), std::max(diff.z, diff.w)));
+      }
+    }
+
+    double joints = (double)bvh.numFrame * numJoints;
+    totalJoints += joints;
+    totalLegacy += bestLegacy;
+    totalFast += bestFast;
+
+    printf("%-40s %8d %8d %16.0f %16.0f %7.2fx %10.3g\n", files[f], numJoints, bvh.numFrame,
+           joints / bestLegacy, joints / bestFast, bestLegacy / bestFast, maxDiff);
+  }
+
+  if(totalFast > 0.)
+  {
+    printf("%-40s %8s %8s %16.0f %16.0f %7.2fx\n", "total", "", "",
+           totalJoints / totalLegacy, totalJoints / totalFast, totalLegacy / totalFast);
+  }
+  return 0;
+}
+
+int BenchmarkKeyframeInterpolation(int numFiles, char ** files, int keySpacing)
+{
+  printf("%-40s %8s %8s %12s %12s %12s %12s %12s %12s %12s %12s\n", "file", "frames", "keys",
+         "euler ms", "slerp ms", "nlerp ms", "spline ms", "euler edit", "slerp edit", "nlerp edit", "spline edit");
+
+  for(int f = 0; f < numFiles; f++)
+  {
+    BVH bvh;
+    bvh.useStreaming = false;
+    bvh.Load(files[f]);
+    if(!bvh.isLoadSuccess || bvh.numFrame < 2)
+    {
+      printf("%-40s could not be loaded\n", files[f]);
+      continue;
+    }
+
+    for(int i = 0; i < bvh.numFrame; i += keySpacing){ bvh.keyframes.Add(i); }
+    bvh.keyframes.Add(bvh.numFrame - 1);
+
+    // a key in the middle of the clip is edited each time
+    bvh.Decompress();
+    int editFrame = bvh.keyframes[bvh.keyframes.Count() / 2];
+    double * editValue = bvh.motion + (long)editFrame * bvh.numChannel + bvh.numChannel - 1;
+
+    // the whole clip, then only what one edit touched
+    double full[4];
+    double edit[4];
+    for(int mode = 0; mode <= INTERPOLATE_SPLINE; mode++)
+    {
+      bvh.interpolation = mode;
+      full[mode] = 1e30;
+      edit[mode] = 1e30;
+      for(int r = 0; r < BENCHMARK_REPEATS; r++)
+      {
+        bvh.keyframes.SetAllDirty();
+        double start = Now();
+        bvh.LerpKeyframes();
+        double middle = Now();
+
+        *editValue += 1.;
+        bvh.keyframes.Changed(editFrame);
+        bvh.LerpKeyframes();
+        double stop = Now();
+
+        if(middle - start < full[mode]){ full[mode] = middle - start; }
+        if(stop - middle < edit[mode]){ edit[mode] = stop - middle; }
+      }
+    }
+
+    printf("%-40s %8d %8d %12.3f %12.3f %12.3f %12.3f %12.4f %12.4f %12.4f %12.4f\n", files[f], bvh.numFrame,
+           bvh.keyframes.Count(), full[INTERPOLATE_EULER] * 1000., full[INTERPOLATE_SLERP] * 1000.,
+           full[INTERPOLATE_NLERP] * 1000., full[INTERPOLATE_SPLINE] * 1000., edit[INTERPOLATE_EULER] * 1000.,
+           edit[INTERPOLATE_SLERP] * 1000., edit[INTERPOLATE_NLERP] * 1000., edit[INTERPOLATE_SPLINE] * 1000.);
+  }
+  return 0;
+}
+
+int BenchmarkInverseKinematics(int numFiles, char ** files, int maxIterations)
+{
+  printf("%-40s %-9s %8s %10s %8s %12s %8s\n", "file", "solver", "drags", "us/drag", "steps", "mean error", "solved");
+
+  for(int f = 0; f < numFiles; f++)
+  {
+    BVH bvh;
+    bvh.useStreaming = false;
+    bvh.Load(files[f]);
+    if(!bvh.isLoadSuccess || bvh.numFrame < 1)
+    {
+      printf("%-40s could not be loaded\n", files[f]);
+      continue;
+    }
+    bvh.FindMinMax();
+
+    // close enough is a thousandth of the body's size
+    double tolerance = 1e-3 * bvh.boundingBoxSize;
+
+    // Goals are where each end joint really gets to with every channel
+    // above it turned a little, the same goals for every solver
+    struct Drag { int frame; int joint; glm::dvec3 goal; };
+    std::vector<Drag> drags;
+    std::vector<double> frame(bvh.numChannel);
+    srand(1);
+    for(int s = 0; s < IK_BENCHMARK_FRAMES; s++)
+    {
+      int frameNo = (long)s * bvh.numFrame / IK_BENCHMARK_FRAMES;
+      for(size_t j = 0; j < bvh.joints.size(); j++)
+      {
+        if(!bvh.joints[j]->hasSite || bvh.joints[j]->parent == NULL){ continue; }
+
+        memcpy(frame.data(), bvh.FrameData(frameNo), bvh.numChannel * sizeof(double));
+        for(int p = bvh.skeleton.parent[j]; p >= 0; p = bvh.skeleton.parent[p])
+        {
+          for(int r = 0; r < bvh.skeleton.rotationCount[p]; r++)
+          {
+            double turn = IK_BENCHMARK_TURN * (2. * rand() / RAND_MAX - 1.);
+            frame[bvh.skeleton.rotationChannel[3 * p + r]] += turn;
+          }
+        }
+        bvh.ForwardKinematics(frame.data());
+
+        Drag drag = { frameNo, (int)j, glm::dvec3(bvh.globalMatrices[j][3]) };
+        drags.push_back(drag);
+      }
+    }
+
+    for(int type = 0; type < IK_SOLVER_COUNT; type++)
+    {
+      bvh.SetIKSolver(type);
+      bvh.ikMaxIterations = maxIterations;
+      bvh.ikTolerance = tolerance;
+      bvh.ikTimeBudget = 0;
+
+      double seconds = 0., error = 0.;
+      long steps = 0;
+      int solved = 0;
+      for(size_t d = 0; d < drags.size(); d++)
+      {
+        memcpy(frame.data(), bvh.FrameData(drags[d].frame), bvh.numChannel * sizeof(double));
+        bvh.ik.joints.assign(1, drags[d].joint);
+        bvh.ik.goals.assign(1, drags[d].goal);
+
+        double start = Now();
+        bvh.SolveIK(bvh.ik, frame.data());
+        seconds += Now() - start;
+
+        steps += bvh.ik.iterations;
+        error += bvh.ik.error;
+        if(bvh.ik.error <= tolerance){ solved++; }
+      }
+
+      int count = std::max((int)drags.size(), 1);
+      printf("%-40s %-9s %8d %10.2f %8.2f %12.5f %7.1f%%\n", files[f], bvh.ik.solver->Name(), (int)drags.size(),
+             seconds * 1e6 / count, (double)steps / count, error / count, 100. * solved / count);
+    }
+  }
+  return 0;
+}
+
+////////////////
+// SELF TEST
+////////////////
+
+// frames apart the keys are that selftest lerps between
+#define SELFTEST_KEY_SPACING 10
+
+// key edits, adds and removes made before checking the incremental lerp
+#define SELFTEST_EDITS 30
+
+// the glm::rotate forward kinematics rounds differently in float, so
+// only has to agree with the fast evaluators to this, relative to each value
+#define SELFTEST_FK_TOLERANCE 1e-5
+
+// the copy of each clip written out is repeated until it is at
+// least this big, so loading it takes the streaming path
+#define SELFTEST_STREAM_BYTES (8 * 1024 * 1024)
+
+// frames of each clip the IK Jacobian is checked on
+#define SELFTEST_IK_FRAMES 4
+
+// degrees, or units, each channel is moved either way to
+// see how far that takes the moved joints
+#define SELFTEST_IK_DELTA 0.2
+
+// those moves are posed in float, so they only have to agree with
+// the Jacobian to this, relative to its biggest entry
+#define SELFTEST_IK_TOLERANCE 1e-3
+
+// random values ParseDouble and FormatDouble are tried on besides the clips' own
+#define SELFTEST_NUMBERS 100000
+
+// the parallel parser is tried in every chunk count up to this,
+// whatever size the clip and however many cores there are
+#define SELFTEST_CHUNKS 8
+
+// prints one check's result, counting it in failures if it failed
+static void Report(const char * file, const char * check, bool passed, const char * detail, int & failures)
+{
+  printf("%-40s %-8s %-6s %s\n", file, check, passed ? "ok" : "FAILED", detail);
+  if(!passed){ failures++; }
+}
+
+// Writes value with FormatDouble and reads it back with ParseDouble.
+// The shortest text has to give back exactly the same double, fixed
+// places have to be within half of the last place.
+static bool RoundTrips(double value, int precision)
+{
+  char text[MAX_DOUBLE_CHARS];
+  char * end = FormatDouble(text, value, precision);
+  const char * p = text;
+  double back;
+  if(!ParseDouble(p, end, back) || p != end){ return false; }
+
+  if(precision == SHORTEST_PRECISION){ return memcmp(&back, &value, sizeof(double)) == 0; }
+  return fabs(back - value) <= 0.5 / exactPowersOfTen[precision] + 1e-15 * (1. + fabs(value));
+}
+
+static size_t FileSize(const string & fileName)
+{
+  struct stat info;
+  return stat(fileName.c_str(), &info) == 0 ? info.st_size : 0;
+}
+
+// makes the clip copies of its first numFrame frames one after another
+static bool RepeatFrames(BVH & bvh, int numFrame, long copies)
+{
+  if(!bvh.ReserveFrames(numFrame * copies)){ return false; }
+
+  long frameValues = (long)numFrame * bvh.numChannel;
+  for(long c = 1; c < copies; c++)
+  {
+    memcpy(bvh.motion + c * frameValues, bvh.motion, frameValues * sizeof(double));
+  }
+  bvh.numFrame = numFrame * copies;
+  bvh.numFrameLoaded = bvh.numFrame;
+  return true;
+}
+
+// same hierarchy and the very same bytes in every frame
+static bool SameClip(const BVH & a, const BVH & b)
+{
+  if(!a.isLoadSuccess || !b.isLoadSuccess){ return false; }
+  if(a.numFrame != b.numFrame || a.numChannel != b.numChannel || a.interval != b.interval){ return false; }
+  if(a.joints.size() != b.joints.size()){ return false; }
+
+  for(size_t j = 0; j < a.joints.size(); j++)
+  {
+    const BVH::Joint * x = a.joints[j];
+    const BVH::Joint * y = b.joints[j];
+    if(x->name != y->name || x->hasSite != y->hasSite || x->channels.size() != y->channels.size()){ return false; }
+    if((x->parent ? x->parent->index : -1) != (y->parent ? y->parent->index : -1)){ return false; }
+    if(memcmp(x->offset, y->offset, sizeof(x->offset)) != 0){ return false; }
+    if(x->hasSite && memcmp(x->site, y->site, sizeof(x->site)) != 0){ return false; }
+    for(size_t c = 0; c < x->channels.size(); c++)
+    {
+      if(x->channels[c]->type != y->channels[c]->type){ return false; }
+    }
+  }
+  return memcmp(a.motion, b.motion, (size_t)a.numFrame * a.numChannel * sizeof(double)) == 0;
+}
+
+// ParseMotion on the clip against the strtok + atof parse, and ParseDouble
+// against strtod on random values printed the ways other programs print them
+static bool CheckParseMotion(const char * file, const BVH & bvh, char * detail, size_t detailSize)
+{
+  MappedFile mapped;
+  const char * begin = mapped.Open(file) ? FindMotionData(mapped.data, mapped.size) : NULL;
+  if(begin == NULL)
+  {
+    snprintf(detail, detailSize, "could not find the MOTION block");
+    return false;
+  }
+  const char * end = mapped.data + mapped.size;
+
+  long values = (long)bvh.numFrame * bvh.numChannel;
+  std::vector<double> legacy(values);
+  std::vector<double> fast(values);
+  int legacyFrames = LegacyParseMotion(begin, end, legacy.data(), bvh.numFrame, bvh.numChannel);
+  int fastFrames = ParseMotion(begin, end, fast.data(), bvh.numFrame, bvh.numChannel);
+
+  long failed = 0;
+  for(long i = 0; i < values; i++)
+  {
+    if(memcmp(&legacy[i], &fast[i], sizeof(double)) != 0){ failed++; }
+  }
+
+  // full 53 bit mantissas across the sizes mocap uses
+  static const char * formats[] = { "%.17g", "%.6f", "%.4e", "%g" };
+  srand(1);
+  for(int i = 0; i < SELFTEST_NUMBERS; i++)
+  {
+    double mantissa = (double)(((uint64_t)rand() << 31) ^ rand()) / 4294967296. / 1048576.;
+    double value = ldexp(mantissa, rand() % 64 - 32) * (rand() % 2 ? 1. : -1.);
+    char text[64];
+    int length = snprintf(text, sizeof(text), formats[i % 4], value);
+
+    const char * p = text;
+    double fastValue;
+    double slowValue = strtod(text, NULL);
+    if(!ParseDouble(p, text + length, fastValue) || p != text + length ||
+       memcmp(&fastValue, &slowValue, sizeof(double)) != 0){ failed++; }
+  }
+
+  snprintf(detail, detailSize, "%d frames and %d other numbers, %ld read differently", fastFrames, SELFTEST_NUMBERS, failed);
+  return legacyFrames == bvh.numFrame && fastFrames == bvh.numFrame && failed == 0;
+}
+
+// The MOTION block parsed in 2 to SELFTEST_CHUNKS chunks
+// against the same block parsed in one go
+static bool CheckParallelParse(const char * file, const BVH & bvh, char * detail, size_t detailSize)
+{
+  MappedFile mapped;
+  const char * begin = mapped.Open(file) ? FindMotionData(mapped.data, mapped.size) : NULL;
+  if(begin == NULL)
+  {
+    snprintf(detail, detailSize, "could not find the MOTION block");
+    return false;
+  }
+  const char * end = mapped.data + mapped.size;
+
+  long values = (long)bvh.numFrame * bvh.numChannel;
+  std::vector<double> serial(values);
+  std::vector<double> parallel(values);
+  int expected = ParseMotion(begin, end, serial.data(), bvh.numFrame, bvh.numChannel);
+
+  int differ = 0;
+  for(int chunks = 2; chunks <= SELFTEST_CHUNKS; chunks++)
+  {
+    std::fill(parallel.begin(), parallel.end(), 0.);
+    int framesRead = ParseMotionParallel(begin, end, parallel.data(), bvh.numFrame, bvh.numChannel, chunks);
+    if(framesRead != expected || memcmp(parallel.data(), serial.data(), values * sizeof(double)) != 0){ differ++; }
+  }
+
+  snprintf(detail, detailSize, "%d frames in 2 to %d chunks, %d chunk counts differ", expected, SELFTEST_CHUNKS, differ);
+  return expected == bvh.numFrame && differ == 0;
+}
+
+// Every frame posed by the fast evaluators against the glm::rotate version
+static bool CheckForwardKinematics(BVH & bvh, char * detail, size_t detailSize)
+{
+  const Skeleton & skeleton = bvh.skeleton;
+  int numJoints = skeleton.numJoints;
+  std::vector<glm::mat4> local(numJoints);
+  std::vector<glm::mat4> legacy(numJoints);
+  std::vector<glm::mat4> fast(numJoints);
+
+  double worst = 0.;
+  for(int i = 0; i < bvh.numFrame; i++)
+  {
+    LegacyForwardKinematics(skeleton, bvh.FrameData(i), local.data(), legacy.data());
+    skeleton.ForwardKinematics(bvh.FrameData(i), local.data(), fast.data());
+
+    for(int j = 0; j < numJoints; j++)
+    {
+      for(int c = 0; c < 4; c++)
+      {
+        for(int r = 0; r < 4; r++)
+        {
+          worst = std::max(worst, fabs(fast[j][c][r] - legacy[j][c][r]) / (1. + fabs(legacy[j][c][r])));
+        }
+      }
+    }
+  }
+
+  snprintf(detail, detailSize, "%d frames, %.3g from glm::rotate", bvh.numFrame, worst);
+  return worst <= SELFTEST_FK_TOLERANCE;
+}
+
+// ClipPoses on every core against posing one frame at a time
+static bool CheckClipPoses(BVH & bvh, char * detail, size_t detailSize)
+{
+  const Skeleton & skeleton = bvh.skeleton;
+  int numJoints = skeleton.numJoints;
+  std::vector<glm::mat4> local(numJoints);
+  std::vector<glm::mat4> global(numJoints);
+  std::vector<glm::vec3> positions((long)bvh.numFrame * numJoints);
+  bvh.ClipPoses(0, bvh.numFrame, positions.data(), NULL);
+
+  long moved = 0;
+  for(int i = 0; i < bvh.numFrame; i++)
+  {
+    skeleton.ForwardKinematics(bvh.FrameData(i), local.data(), global.data());
+    for(int j = 0; j < numJoints; j++)
+    {
+      glm::vec3 position = glm::vec3(global[j][3]);
+      if(memcmp(&positions[(long)i * numJoints + j], &position, sizeof(position)) != 0){ moved++; }
+    }
+  }
+
+  snprintf(detail, detailSize, "%d frames, %ld joint positions differ", bvh.numFrame, moved);
+  return moved == 0;
+}
+
+// The Jacobian solver's columns, with every end joint and the root
+// moved at once, against moving each channel a little either way
+static bool CheckJacobian(BVH & bvh, char * detail, size_t detailSize)
+{
+  const Skeleton & skeleton = bvh.skeleton;
+  IKWorkspace ik;
+  for(int j = 0; j < skeleton.numJoints; j++)
+  {
+    if(skeleton.parent[j] < 0 || bvh.joints[j]->hasSite){ ik.joints.push_back(j); }
+  }
+  ik.BuildChain(bvh);
+  int numEffectors = ik.joints.size();
+  int numColumns = ik.channels.size();
+  ik.effectors.resize(numEffectors);
+
+  std::vector<double> frame(bvh.numChannel);
+  std::vector<double> jacobian;
+  std::vector<glm::dvec3> forward(numEffectors);
+  double worst = 0.;
+  for(int s = 0; s < SELFTEST_IK_FRAMES; s++)
+  {
+    int frameNo = (long)s * bvh.numFrame / SELFTEST_IK_FRAMES;
+    memcpy(frame.data(), bvh.FrameData(frameNo), bvh.numChannel * sizeof(double));
+    ik.Pose(skeleton, frame.data());
+    for(int i = 0; i < numEffectors; i++){ ik.effectors[i] = glm::dvec3(ik.globalMatrices[ik.joints[i]][3]); }
+    IKJacobian(bvh, ik, frame.data(), jacobian);
+
+    double biggest = 1e-12;
+    for(size_t e = 0; e < jacobian.size(); e++){ biggest = std::max(biggest, fabs(jacobian[e])); }
+
+    // central differences, posing with the channel moved up and then down
+    for(int c = 0; c < numColumns; c++)
+    {
+      double & value = frame[ik.channels[c]];
+      double original = value;
+      value = original + SELFTEST_IK_DELTA;
+      ik.Pose(skeleton, frame.data());
+      for(int i = 0; i < numEffectors; i++){ forward[i] = glm::dvec3(ik.globalMatrices[ik.joints[i]][3]); }
+      value = original - SELFTEST_IK_DELTA;
+      ik.Pose(skeleton, frame.data());
+      value = original;
+
+      for(int i = 0; i < numEffectors; i++)
+      {
+        glm::dvec3 moved = (forward[i] - glm::dvec3(ik.globalMatrices[ik.joints[i]][3])) / (2. * SELFTEST_IK_DELTA);
+        for(int a = 0; a < 3; a++)
+        {
+          worst = std::max(worst, fabs(moved[a] - jacobian[(long)(3 * i + a) * numColumns + c]) / biggest);
+        }
+      }
+    }
+  }
+
+  snprintf(detail, detailSize, "%d joints by %d channels on %d frames, %.3g from finite differences",
+           numEffectors, numColumns, SELFTEST_IK_FRAMES, worst);
+  return worst <= SELFTEST_IK_TOLERANCE;
+}
+
+// FormatDouble on every value of the clip at every precision, and
+// on random values no clip has at full precision
+static bool CheckFormatDouble(const BVH & bvh, char * detail, size_t detailSize)
+{
+  long values = (long)bvh.numFrame * bvh.numChannel;
+  long failed = 0;
+  for(long i = 0; i < values; i++)
+  {
+    bool readsBack = true;
+    for(int precision = SHORTEST_PRECISION; precision <= MAX_FIXED_PRECISION; precision++)
+    {
+      readsBack = readsBack && RoundTrips(bvh.motion[i], precision);
+    }
+    if(!readsBack){ failed++; }
+  }
+
+  // full 53 bit mantissas across the sizes mocap uses, and the edges
+  static const double edges[] =
+  {
+    0., -0., 1., -1., 0.1, 1. / 3., 123.456, 1e-7, 999999999.9999999, 1e9, 1e21,
+    9007199254740993., DBL_MIN, DBL_MAX, 5e-324
+  };
+  srand(1);
+  for(int i = 0; i < SELFTEST_NUMBERS; i++)
+  {
+    double mantissa = (double)(((uint64_t)rand() << 31) ^ rand()) / 4294967296. / 1048576.;
+    double value = ldexp(mantissa, rand() % 64 - 32) * (rand() % 2 ? 1. : -1.);
+    if(!RoundTrips(value, SHORTEST_PRECISION)){ failed++; }
+  }
+  for(size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+  {
+    if(!RoundTrips(edges[i], SHORTEST_PRECISION)){ failed++; }
+  }
+
+  snprintf(detail, detailSize, "%ld values and %d others, %ld did not read back", values, SELFTEST_NUMBERS, failed);
+  return failed == 0;
+}
+
+// Edits, adds and removes keys lerping after each, then checks that
+// came out the same as a fresh copy with the same keys lerped in one go
+static bool CheckIncrementalLerp(const char * file, int mode, char * detail, size_t detailSize)
+{
+  BVH bvh;
+  bvh.useStreaming = false;
+  bvh.Load(file);
+  bvh.interpolation = mode;
+  for(int i = 0; i < bvh.numFrame; i += SELFTEST_KEY_SPACING){ bvh.keyframes.Add(i); }
+  bvh.keyframes.Add(bvh.numFrame - 1);
+  bvh.LerpKeyframes();
+
+  srand(1);
+  for(int e = 0; e < SELFTEST_EDITS; e++)
+  {
+    int frame = rand() % bvh.numFrame;
+    if(e % 3 == 0)
+    {
+      // turned the way a drag would
+      frame = bvh.keyframes[rand() % bvh.keyframes.Count()];
+      bvh.motion[(long)frame * bvh.numChannel + rand() % bvh.numChannel] += 20. * rand() / RAND_MAX - 10.;
+      bvh.keyframes.Changed(frame);
+    }
+    else if(e % 3 == 1)           { bvh.keyframes.Add(frame); }
+    else if(bvh.keyframes.Count() > 2){ bvh.keyframes.Remove(frame); }
+    bvh.LerpKeyframes();
+  }
+
+  BVH full;
+  full.useStreaming = false;
+  full.Load(file);
+  full.interpolation = mode;
+  memcpy(full.motion, bvh.motion, (size_t)bvh.numFrame * bvh.numChannel * sizeof(double));
+  for(int k = 0; k < bvh.keyframes.Count(); k++){ full.keyframes.Add(bvh.keyframes[k]); }
+  full.keyframes.SetAllDirty();
+  full.LerpKeyframes();
+
+  long differ = 0;
+  for(long i = 0; i < (long)bvh.numFrame * bvh.numChannel; i++)
+  {
+    if(memcmp(&bvh.motion[i], &full.motion[i], sizeof(double)) != 0){ differ++; }
+  }
+  snprintf(detail, detailSize, "%d keys after %d edits, %ld values differ", bvh.keyframes.Count(), SELFTEST_EDITS, differ);
+  return differ == 0;
+}
+
+int SelfTest(int numFiles, char ** files)
+{
+  static const char * modes[] = { "euler", "slerp", "nlerp", "spline" };
+  int failures = 0;
+  char detail[256];
+
+  // the copies saved and the caches written go in the temp folder
+  const char * tempFolder = getenv("TMPDIR");
+  string scratch = string(tempFolder ? tempFolder : "/tmp") + "/bvhtool-selftest-" + std::to_string(getpid()) + ".bvh";
+  string cache = BVH::CacheFileName(scratch.c_str());
+
+  printf("%-40s %-8s %-6s %s\n", "file", "check", "result", "detail");
+
+  for(int f = 0; f < numFiles; f++)
+  {
+    BVH bvh;
+    bvh.useStreaming = false;
+    bvh.Load(files[f]);
+    if(!bvh.isLoadSuccess)
+    {
+      Report(files[f], "load", false, "could not be loaded", failures);
+      continue;
+    }
+
+    bool passed = CheckParseMotion(files[f], bvh, detail, sizeof(detail));
+    Report(files[f], "parse", passed, detail, failures);
+
+    passed = CheckParallelParse(files[f], bvh, detail, sizeof(detail));
+    Report(files[f], "parallel", passed, detail, failures);
+
+    passed = CheckForwardKinematics(bvh, detail, sizeof(detail));
+    Report(files[f], "fk", passed, detail, failures);
+
+    passed = CheckClipPoses(bvh, detail, sizeof(detail));
+    Report(files[f], "poses", passed, detail, failures);
+
+    passed = CheckJacobian(bvh, detail, sizeof(detail));
+    Report(files[f], "jacobian", passed, detail, failures);
+
+    passed = CheckFormatDouble(bvh, detail, sizeof(detail));
+    Report(files[f], "format", passed, detail, failures);
+
+    // a single frame has nothing to lerp
+    for(int mode = 0; mode <= INTERPOLATE_SPLINE && bvh.numFrame > 1; mode++)
+    {
+      passed = CheckIncrementalLerp(files[f], mode, detail, sizeof(detail));
+      Report(files[f], modes[mode], passed, detail, failures);
+    }
+
+    // Saved exactly, then repeated until it is long enough to stream.
+    // The text parse of that is what streaming and the cache must match.
+    if(!bvh.SaveFile(scratch))
+    {
+      Report(files[f], "save", false, "could not save a copy to the temp folder", failures);
+      continue;
+    }
+
+    // one copy's MOTION text is what doubling the frames adds to the file
+    int numFrame = bvh.numFrame;
+    size_t once = FileSize(scratch);
+    RepeatFrames(bvh, numFrame, 2);
+    bvh.SaveFile(scratch);
+    size_t motionBytes = std::max(FileSize(scratch), once + 1) - once;
+    long copies = SELFTEST_STREAM_BYTES / motionBytes + 1;
+    if(copies > 2 && (long)numFrame * copies <= INT_MAX && RepeatFrames(bvh, numFrame, copies))
+    {
+      bvh.SaveFile(scratch);
+    }
+
+    BVH text;
+    text.useStreaming = false;
+    text.Load(scratch.c_str());
+    snprintf(detail, sizeof(detail), "%d frames saved and loaded again", bvh.numFrame);
+    Report(files[f], "save", SameClip(bvh, text), detail, failures);
+
+    BVH streamed;
+    streamed.Load(scratch.c_str());
+    bool wasStreaming = streamed.IsLoading();
+    streamed.WaitForLoad();
+    snprintf(detail, sizeof(detail), "%d frames, %s", streamed.numFrame, wasStreaming ? "streamed" : "loaded without streaming");
+    Report(files[f], "stream", SameClip(text, streamed), detail, failures);
+
+    // the first load writes the cache, the second maps it
+    BVH writer;
+    writer.useStreaming = false;
+    writer.useMotionCache = true;
+    writer.Load(scratch.c_str());
+    BVH cached;
+    cached.useMotionCache = true;
+    cached.verifyMotionCache = true;
+    cached.Load(scratch.c_str());
+    snprintf(detail, sizeof(detail), "%d frames, %s", cached.numFrame, cached.motionFile ? "mapped from the cache" : "no cache was used");
+    Report(files[f], "cache", cached.motionFile != NULL && SameClip(text, cached), detail, failures);
+    remove(cache.c_str());
+
+    // with the last frame cut off, streamed or not, the load has to fail
+    MappedFile saved;
+    size_t lastLine = 0;
+    if(saved.Open(scratch.c_str()) && saved.size > 1)
+    {
+      const char * p = saved.data + saved.size - 1;
+      while(p > saved.data && p[-1] != '\n'){ p--; }
+      lastLine = p - saved.data;
+    }
+    saved.Close();
+    if(lastLine > 0 && truncate(scratch.c_str(), lastLine) == 0)
+    {
+      BVH shortText;
+      shortText.useStreaming = false;
+      shortText.Load(scratch.c_str());
+      BVH shortStreamed;
+      shortStreamed.Load(scratch.c_str());
+      shortStreamed.WaitForLoad();
+      snprintf(detail, sizeof(detail), "last frame cut, text %s, streamed %s", shortText.isLoadSuccess ? "loaded" : "failed",
+               shortStreamed.isLoadSuccess ? "loaded" : "failed");
+      Report(files[f], "short", !shortText.isLoadSuccess && !shortStreamed.isLoadSuccess, detail, failures);
+    }
+
+    remove(scratch.c_str());
+  }
+
+  printf("%d check%s failed\n", failures, failures == 1 ? "" : "s");
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	Benchmark.h
+//	------------------------
+//
+//	Timings for the slow parts of loading and posing,
+//	and checks that the fast versions still give what
+//	the slow ones do, run from the command line rather
+//	than the GUI
+//
+///////////////////////////////////////////////////
+
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+// compares the old strtok + atof MOTION parsing against
+// ParseMotion and ParseMotionParallel, printing MB/s for each file.
+// The parallel parse uses numChunks threads, or the loader's own
+// choice of one per core if it is 0.
+int BenchmarkMotionParsing(int numFiles, char ** files, int numChunks);
+
+// compares the glm::translate + glm::rotate forward kinematics against
+// Skeleton::ForwardKinematics, printing joints posed a second for each file
+int BenchmarkForwardKinematics(int numFiles, char ** files);
+
+// keys every keySpacing frames, then times LerpKeyframes with each
+// KeyInterpolation over the whole clip and after editing one key
+int BenchmarkKeyframeInterpolation(int numFiles, char ** files, int keySpacing);
+
+// drags every end joint to goals it can reach on frames across each
+// clip, printing the time, steps and error of each IKSolverType
+int BenchmarkInverseKinematics(int numFiles, char ** files, int maxIterations);
+
+// Checks each file's MOTION block parsed by ParseMotion against the
+// strtok + atof parse, and parsed in parallel chunks against one
+// ParseMotion, forward kinematics against the glm::rotate version,
+// ClipPoses against posing one frame at a time, the IK Jacobian
+// against finite differences, FormatDouble reading back exactly,
+// incremental lerps against lerping every span, and a saved copy
+// loading back the same, as text, by streaming and from a .bvhb
+// cache, and failing both ways once its last frame is cut. Returns 1
+// if any fail.
+int SelfTest(int numFiles, char ** files);
+
+#endif
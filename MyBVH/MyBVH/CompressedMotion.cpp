@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	CompressedMotion.cpp
+//	------------------------
+//
+//	Stores a clip as 16 bit samples scaled to each
+//	channel's range, a quarter the size of doubles
+//
+///////////////////////////////////////////////////
+
+#include <cmath>
+#include <algorithm>
+#include "CompressedMotion.h"
+
+// largest 16 bit sample
+#define SAMPLE_MAX 65535.
+
+size_t CompressedMotion::Bytes() const
+{
+  return sizeof(CompressedMotion) +
+         (channelMin.size() + channelScale.size()) * sizeof(double) +
+         varying.size() * sizeof(int) +
+         samples.size() * sizeof(uint16_t);
+}
+
+void CompressMotion(const double * motion, int numFrame, int numChannel, CompressedMotion & compressed)
+{
+  compressed.numFrame = numFrame;
+  compressed.numChannel = numChannel;
+  compressed.channelMin.assign(numChannel, 0.);
+  compressed.channelScale.assign(numChannel, 0.);
+  compressed.varying.clear();
+
+  // find the range of every channel over the clip
+  std::vector<double> channelMax(numChannel, 0.);
+  if(numFrame > 0)
+  {
+    for(int c = 0; c < numChannel; c++)
+    {
+      compressed.channelMin[c] = motion[c];
+      channelMax[c] = motion[c];
+    }
+  }
+  for(int i = 1; i < numFrame; i++)
+  {
+    const double * frame = motion + (long)i * numChannel;
+    for(int c = 0; c < numChannel; c++)
+    {
+      if(frame[c] < compressed.channelMin[c]){ compressed.channelMin[c] = frame[c]; }
+      if(frame[c] > channelMax[c])           { channelMax[c] = frame[c]; }
+    }
+  }
+
+  // a channel with no range only needs its one value
+  for(int c = 0; c < numChannel; c++)
+  {
+    double range = channelMax[c] - compressed.channelMin[c];
+    if(range > 0.)
+    {
+      compressed.channelScale[c] = range / SAMPLE_MAX;
+      compressed.varying.push_back(c);
+    }
+  }
+
+  int numVarying = compressed.varying.size();
+  compressed.samples.resize((size_t)numFrame * numVarying);
+  compressed.samples.shrink_to_fit();
+
+  for(int i = 0; i < numFrame; i++)
+  {
+    const double * frame = motion + (long)i * numChannel;
+    uint16_t * out = compressed.samples.data() + (size_t)i * numVarying;
+    for(int v = 0; v < numVarying; v++)
+    {
+      int c = compressed.varying[v];
+      double sample = (frame[c] - compressed.channelMin[c]) / compressed.channelScale[c];
+      out[v] = (uint16_t)std::min(SAMPLE_MAX, std::max(0., floor(sample + 0.5)));
+    }
+  }
+}
+
+void DecompressFrame(const CompressedMotion & compressed, int frame, double * out)
+{
+  int numVarying = compressed.varying.size();
+  const uint16_t * in = compressed.samples.data() + (size_t)frame * numVarying;
+
+  // constant channels first, then overwrite the ones that move
+  for(int c = 0; c < compressed.numChannel; c++)
+  {
+    out[c] = compressed.channelMin[c];
+  }
+  for(int v = 0; v < numVarying; v++)
+  {
+    int c = compressed.varying[v];
+    out[c] = compressed.channelMin[c] + in[v] * compressed.channelScale[c];
+  }
+}
+
+void DecompressMotion(const CompressedMotion & compressed, double * out)
+{
+  for(int i = 0; i < compressed.numFrame; i++)
+  {
+    DecompressFrame(compressed, i, out + (long)i * compressed.numChannel);
+  }
+}
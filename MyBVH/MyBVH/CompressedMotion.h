@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	CompressedMotion.h
+//	------------------------
+//
+//	Stores a clip as 16 bit samples scaled to each
+//	channel's range, a quarter the size of doubles
+//
+///////////////////////////////////////////////////
+
+#ifndef _COMPRESSED_MOTION_H_
+#define _COMPRESSED_MOTION_H_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Each channel is stored as min + sample * scale, where the
+// samples span the channel's whole range over the clip. The
+// error is at most half a step, (max - min) / 131070, so even
+// a rotation that sweeps 360 degrees is within 0.003 degrees.
+// Channels that never change, common for fingers and toes,
+// cost nothing beyond their one value.
+struct CompressedMotion
+{
+  int numFrame;
+  int numChannel;
+
+  // per channel, value = channelMin + sample * channelScale
+  std::vector<double> channelMin;
+  std::vector<double> channelScale;
+
+  // channels that change, in the order their samples are stored
+  std::vector<int> varying;
+
+  // numFrame * varying.size() samples, one frame after another
+  std::vector<uint16_t> samples;
+
+  // bytes held, for comparing against the dense array
+  size_t Bytes() const;
+};
+
+// quantizes numFrame frames of numChannel doubles
+void CompressMotion(const double * motion, int numFrame, int numChannel, CompressedMotion & compressed);
+
+// writes numChannel doubles for one frame into out
+void DecompressFrame(const CompressedMotion & compressed, int frame, double * out);
+
+// writes the whole clip into out, which holds numFrame * numChannel
+void DecompressMotion(const CompressedMotion & compressed, double * out);
+
+#endif
@@ -0,0 +1,250 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	FastFloat.h
+//	------------------------
+//
+//	Locale independent number parsing and printing
+//	for the MOTION block, much faster than atof and
+//	ofstream
+//
+///////////////////////////////////////////////////
+
+#ifndef _FAST_FLOAT_H_
+#define _FAST_FLOAT_H_
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <cstdio>
+
+// the feature macro only exists once <charconv> is in
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+// every power of ten a double can hold exactly
+static const double exactPowersOfTen[] =
+{
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool IsDigit(char c)
+{
+  return (unsigned char)(c - '0') < 10;
+}
+
+// SWAR (SIMD within a register) check that
+// all 8 bytes loaded from the text are digits
+inline bool IsEightDigits(uint64_t v)
+{
+  return (((v & 0xF0F0F0F0F0F0F0F0ULL) |
+          (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL);
+}
+
+// turns 8 digit characters into their value with 3 multiplies
+// rather than 8 rounds of multiply and add
+inline uint32_t ParseEightDigits(uint64_t v)
+{
+  const uint64_t mask = 0x000000FF000000FFULL;
+  const uint64_t mul1 = 0x000F424000000064ULL; // 100 + (1000000 << 32)
+  const uint64_t mul2 = 0x0000271000000001ULL; // 1 + (10000 << 32)
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8);
+  v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+  return (uint32_t)v;
+}
+
+// the byte trick above needs the first digit in the lowest byte
+inline bool CanUseEightDigits()
+{
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+  return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+#else
+  const uint16_t one = 1;
+  return *(const unsigned char *)&one == 1;
+#endif
+}
+
+// Parses a decimal number starting at p without reading past end.
+// Moves p past the number and returns false if there wasn't one.
+// Unlike atof this never looks at the locale, so a German
+// decimal comma can't break loading.
+inline bool ParseDouble(const char *& p, const char * end, double & value)
+{
+  const char * start = p;
+  bool negative = false;
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  bool anyDigits = false;
+  bool truncated = false;
+
+  if(p < end && (*p == '-' || *p == '+')){ negative = (*p == '-'); p++; }
+
+  // integer part, anything past 18 digits only changes the exponent
+  while(p < end && IsDigit(*p))
+  {
+    if(mantissa < 100000000000000000ULL){ mantissa = mantissa * 10 + (*p - '0'); }
+    else                                 { exponent++; truncated |= (*p != '0'); }
+    anyDigits = true;
+    p++;
+  }
+
+  // fractional part, 8 digits at a time where we can
+  if(p < end && *p == '.')
+  {
+    p++;
+    while(CanUseEightDigits() && end - p >= 8 && mantissa < 10000000000ULL)
+    {
+      uint64_t chunk;
+      memcpy(&chunk, p, 8);
+      if(!IsEightDigits(chunk)){ break; }
+      mantissa = mantissa * 100000000ULL + ParseEightDigits(chunk);
+      exponent -= 8;
+      anyDigits = true;
+      p += 8;
+    }
+    while(p < end && IsDigit(*p))
+    {
+      if(mantissa < 100000000000000000ULL){ mantissa = mantissa * 10 + (*p - '0'); exponent--; }
+      else                                 { truncated |= (*p != '0'); }
+      anyDigits = true;
+      p++;
+    }
+  }
+
+  if(!anyDigits){ p = start; return false; }
+
+  // optional exponent, only taken if it is well formed
+  if(p < end && (*p == 'e' || *p == 'E'))
+  {
+    const char * e = p + 1;
+    bool expNegative = false;
+    int expValue = 0;
+    if(e < end && (*e == '-' || *e == '+')){ expNegative = (*e == '-'); e++; }
+    if(e < end && IsDigit(*e))
+    {
+      while(e < end && IsDigit(*e))
+      {
+        if(expValue < 10000){ expValue = expValue * 10 + (*e - '0'); }
+        e++;
+      }
+      exponent += expNegative ? -expValue : expValue;
+      p = e;
+    }
+  }
+
+  // Fast path: both numbers are exact doubles so a single
+  // multiply or divide gives the correctly rounded result
+  if(!truncated && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+  {
+    value = (double)mantissa;
+    if(exponent < 0){ value /= exactPowersOfTen[-exponent]; }
+    else            { value *= exactPowersOfTen[exponent]; }
+    if(negative){ value = -value; }
+    return true;
+  }
+
+  // Slow path for very long or very large numbers, never hit by mocap data
+#ifdef __cpp_lib_to_chars
+  const char * digits = (*start == '+') ? start + 1 : start;
+  if(std::from_chars(digits, p, value).ec == std::errc()){ return true; }
+#endif
+  value = (double)((long double)mantissa * powl(10.0L, exponent));
+  if(negative){ value = -value; }
+  return true;
+}
+
+// longest text FormatDouble writes for one number
+#define MAX_DOUBLE_CHARS 32
+
+// precision that keeps every digit needed to read back the same double
+#define SHORTEST_PRECISION -1
+
+// most decimal places the fixed point path handles
+#define MAX_FIXED_PRECISION 9
+
+// Writes |value| < 1e9 rounded to precision decimal places,
+// dropping trailing zeros so 90.000000 comes out as 90
+inline char * FormatFixed(char * out, double value, int precision)
+{
+  static const int64_t powers[] =
+  {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+  };
+
+  bool negative = value < 0.;
+  int64_t scaled = llround(fabs(value) * exactPowersOfTen[precision]);
+  int64_t whole = scaled / powers[precision];
+  int64_t fraction = scaled % powers[precision];
+
+  // -0.0001 at 2 places is just 0
+  if(negative && scaled != 0){ *out++ = '-'; }
+
+  // digits come out backwards, so build them up in a scratch buffer
+  char digits[20];
+  int count = 0;
+  do { digits[count++] = '0' + (char)(whole % 10); whole /= 10; } while(whole > 0);
+  while(count > 0){ *out++ = digits[--count]; }
+
+  if(fraction == 0){ return out; }
+
+  int places = precision;
+  while(fraction % 10 == 0){ fraction /= 10; places--; }
+  *out++ = '.';
+  for(int i = places - 1; i >= 0; i--)
+  {
+    out[i] = '0' + (char)(fraction % 10);
+    fraction /= 10;
+  }
+  return out + places;
+}
+
+// Writes value as text and returns the end, never more than
+// MAX_DOUBLE_CHARS. SHORTEST_PRECISION gives the shortest text
+// that ParseDouble turns back into exactly the same double,
+// 0 to MAX_FIXED_PRECISION rounds to that many decimal places.
+// Like ParseDouble this ignores the locale.
+inline char * FormatDouble(char * out, double value, int precision)
+{
+  // a BVH can't hold these, so write something loadable
+  if(!std::isfinite(value)){ *out++ = '0'; return out; }
+
+  if(precision >= 0 && precision <= MAX_FIXED_PRECISION && fabs(value) < 1e9)
+  {
+    return FormatFixed(out, value, precision);
+  }
+
+#ifdef __cpp_lib_to_chars
+  return std::to_chars(out, out + MAX_DOUBLE_CHARS, value).ptr;
+#else
+  // try fewer places first, mocap values usually stop at 4 or 6
+  if(fabs(value) < 1e9)
+  {
+    for(int places = 0; places <= MAX_FIXED_PRECISION; places++)
+    {
+      char * end = FormatFixed(out, value, places);
+      const char * p = out;
+      double check;
+      if(ParseDouble(p, end, check) && check == value){ return end; }
+    }
+  }
+
+  // 17 significant digits always reads back exactly
+  int length = snprintf(out, MAX_DOUBLE_CHARS, "%.17g", value);
+  for(int i = 0; i < length; i++)
+  {
+    if(out[i] == ','){ out[i] = '.'; }
+  }
+  return out + length;
+#endif
+}
+
+#endif
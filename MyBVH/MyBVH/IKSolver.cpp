@@ -0,0 +1,634 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	IKSolver.cpp
+//	------------------------
+//
+//	The ways MoveJoint can bring dragged joints
+//	towards where they were dragged to
+//
+///////////////////////////////////////////////////
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+#include "IKSolver.h"
+#include "BVH.h"
+#include "Pose.h"
+
+// bones and reaches shorter than this have no direction to turn
+#define IK_MIN_LENGTH  1e-6
+
+// damping the Jacobian always uses, even with dampening off
+#define IK_MIN_DAMPING  1e-3
+
+// the Jacobian's steps come out in radians but are added to channels
+// in degrees, so its targets are scaled up by this to match
+#define IK_STEP_SCALE  (M_PI / 180.)
+
+// a FABRIK step leaving the joints further off than this much of
+// where the last one did has stalled
+#define IK_STALL  0.8
+
+// The rotation turning from onto to, the short way round
+static glm::dquat RotationBetween(const glm::dvec3 & from, const glm::dvec3 & to)
+{
+  glm::dvec3 f = glm::normalize(from), t = glm::normalize(to);
+  double w = 1. + glm::dot(f, t);
+
+  // pointing opposite ways, any axis at right angles will do
+  if(w < 1e-9)
+  {
+    glm::dvec3 axis = glm::cross(f, glm::dvec3(1., 0., 0.));
+    if(glm::dot(axis, axis) < 1e-12){ axis = glm::cross(f, glm::dvec3(0., 1., 0.)); }
+    return glm::angleAxis(glm::pi<double>(), glm::normalize(axis));
+  }
+
+  glm::dvec3 axis = glm::cross(f, t);
+  return glm::normalize(glm::dquat(w, axis.x, axis.y, axis.z));
+}
+
+// only joints with all three rotation channels can be turned any
+// way, and joints with no weight are held still
+static bool CanTurn(const BVH & bvh, int j)
+{
+  const Skeleton & skeleton = bvh.skeleton;
+  return skeleton.rotationCount[j] == 3 && skeleton.rotationOrder[j] <= ROTATION_ZYX && bvh.ikLimits[j].weight > 0.;
+}
+
+// which way joint j faces, from the last Pose
+static glm::dquat WorldRotation(const IKWorkspace & ik, int j)
+{
+  if(j < 0){ return glm::dquat(1., 0., 0., 0.); }
+  return glm::quat_cast(glm::dmat3(glm::mat3(ik.globalMatrices[j])));
+}
+
+// Writes joint j's channels so it turns by local relative to its parent,
+// with the angles nearest the ones it already had, kept within its
+// limits. Returns the turn it really ended up with.
+static glm::dquat SetLocalRotation(const BVH & bvh, int j, const glm::dquat & local, double * data)
+{
+  static const glm::dvec3 axes[3] =
+  {
+    glm::dvec3(1., 0., 0.), glm::dvec3(0., 1., 0.), glm::dvec3(0., 0., 1.)
+  };
+
+  const Skeleton & skeleton = bvh.skeleton;
+  const IKLimits & limits = bvh.ikLimits[j];
+  const int * rotation = &skeleton.rotationChannel[3 * j];
+  const unsigned char * axis = &skeleton.rotationAxis[3 * j];
+  double reference[3] = { data[rotation[0]], data[rotation[1]], data[rotation[2]] };
+  double angles[3];
+  QuatToEuler(local, axis, reference, angles);
+
+  glm::dquat turned = glm::dquat(1., 0., 0., 0.);
+  for(int r = 0; r < 3; r++)
+  {
+    data[rotation[r]] = std::min(std::max(angles[r], limits.lower[axis[r]]), limits.upper[axis[r]]);
+    turned = turned * glm::angleAxis(glm::radians(data[rotation[r]]), axes[axis[r]]);
+  }
+  return turned;
+}
+
+// The root has nothing above it to turn, its position channels
+// just carry it the rest of the way to its goal
+static void MoveRoot(const BVH & bvh, IKWorkspace & ik, int i, double * data)
+{
+  int root = ik.joints[i];
+  glm::dvec3 miss = ik.goals[i] - glm::dvec3(ik.globalMatrices[root][3]);
+  for(int a = 0; a < 3; a++)
+  {
+    int channel = bvh.skeleton.positionChannel[3 * root + a];
+    if(channel >= 0){ data[channel] += miss[a]; }
+  }
+}
+
+////////////////
+// JACOBIAN
+////////////////
+
+class JacobianSolver : public IKSolver
+{
+public:
+  const char * Name() const { return "Jacobian"; }
+
+  // One damped least squares step moving ik.effectors to ik.goals
+  void Step(const BVH & bvh, IKWorkspace & ik, double * data)
+  {
+    const Skeleton & skeleton = bvh.skeleton;
+    int numJoints = ik.joints.size();
+    int numRows = 3 * numJoints;
+    int numColumns = ik.channels.size();
+    scale.resize(numColumns);
+
+    // how far each moved joint has to go, in the steps' units
+    target.resize(numRows);
+    for(int i = 0; i < numJoints; i++)
+    {
+      glm::dvec3 miss = ik.goals[i] - ik.effectors[i];
+      for(int a = 0; a < 3; a++){ target[(3 * i) + a] = miss[a] / IK_STEP_SCALE; }
+    }
+
+    Derive(bvh, ik, data);
+
+    /////////////////////////
+    // Solve Jacobian
+    ////////////////////////
+
+    // Weighted damped least squares, step = W J^T (J W J^T + lambda^2 I)^-1 v,
+    // solved as plain damped least squares on J scaled by the square
+    // root weights. The system is only 3 rows per moved joint and
+    // positive definite once damped, so an LDLT factorisation solves it
+    // without an inverse. Without dampening a sliver is still added, so
+    // a straightened limb gives a small step rather than an unsolvable
+    // system.
+    double damping = bvh.useDampening ? bvh.lambda : IK_MIN_DAMPING;
+    for(int c = 0; c < numColumns; c++){ scale(c) = sqrt(ik.weights[c]); }
+    held.setZero(numColumns);
+    residual = target;
+
+    // Any channel the step would take past a limit is held at it, what
+    // that does to the effectors comes off the target, and the rest is
+    // solved again without it. Each pass holds at least one more column.
+    for(int pass = 0; pass <= numColumns; pass++)
+    {
+      scaled.noalias() = jacobian * scale.asDiagonal();
+      system.noalias() = scaled * scaled.transpose();
+      system.diagonal().array() += damping * damping;
+      factor.compute(system);
+
+      solve = residual;
+      factor.solveInPlace(solve);
+      step.noalias() = scaled.transpose() * solve;
+
+      //////////////////////////////
+      // CONTROL INVERSE KINEMATICS
+      //////////////////////////////
+      if(bvh.useControl)
+      {
+        // z is zero except the rotation channels of the joints we want
+        // to move, each driven by the gain of the axis it turns about
+        control.setZero(numColumns);
+        double gains[3] = { bvh.xGain, bvh.yGain, bvh.zGain };
+
+        for(int i = 0; i < numJoints; i++)
+        {
+          int index = ik.joints[i];
+          glm::dvec3 v = glm::dvec3(target[3 * i], target[3 * i + 1], target[3 * i + 2]);
+          for(int rot = 0; rot < skeleton.rotationCount[index]; rot++)
+          {
+            int axis = skeleton.rotationAxis[3 * index + rot];
+            int column = ik.columns[skeleton.rotationChannel[3 * index + rot]];
+            control(column) = gains[axis] * v[axis] * v[axis];
+          }
+        }
+
+        // step += (J+ J - I) z, using the same factorisation
+        control = control.cwiseProduct(scale);
+        solve.noalias() = scaled * control;
+        factor.solveInPlace(solve);
+        step.noalias() += scaled.transpose() * solve;
+        step -= control;
+      }
+
+      // back out of the scaled columns, held ones move to their limits
+      step = step.cwiseProduct(scale) + held;
+
+      bool isHeld = false;
+      for(int c = 0; c < numColumns; c++)
+      {
+        if(scale(c) == 0.){ continue; }
+
+        double value = data[ik.channels[c]] + step(c);
+        double limit = std::min(std::max(value, ik.lower[c]), ik.upper[c]);
+        if(limit == value){ continue; }
+
+        scale(c) = 0.;
+        held(c) = limit - data[ik.channels[c]];
+        residual -= jacobian.col(c) * held(c);
+        isHeld = true;
+      }
+      if(!isHeld){ break; }
+    }
+
+    //////////////////////////
+    // APPLY CHANGES
+    //////////////////////////
+    // each column back to the channel it turns
+    for(int c = 0; c < numColumns; c++)
+    {
+      data[ik.channels[c]] += step(c);
+    }
+  }
+
+  // Fills jacobian for ik.effectors as posed from data, a column per
+  // channel, without moving anything
+  void Derive(const BVH & bvh, const IKWorkspace & ik, const double * data)
+  {
+    const Skeleton & skeleton = bvh.skeleton;
+    int numJoints = ik.joints.size();
+    int numRows = 3 * numJoints;
+    int numColumns = ik.channels.size();
+    axes.resize(numColumns);
+    pivots.resize(numColumns);
+
+    static const glm::dvec3 unitAxes[3] =
+    {
+      glm::dvec3(1., 0., 0.), glm::dvec3(0., 1., 0.), glm::dvec3(0., 0., 1.)
+    };
+
+    // Each rotation channel turns everything below it about one axis
+    // through its joint. Those axes only depend on the joints above, so
+    // they are found once per column however many moved joints share
+    // it. A joint's columns are next to each other, in the order its
+    // channels apply. Everything needed is in the matrices from the last
+    // forward kinematics, no chain is run again.
+    glm::dmat3 turned;
+    for(int c = 0; c < numColumns; c++)
+    {
+      int channel = ik.channels[c];
+      int type = skeleton.channelType[channel];
+      int joint = ik.columnJoints[c];
+
+      // the root's position channels move everything along the scene's own axes
+      if(type >= BVH::X_POSITION)
+      {
+        axes[c] = unitAxes[type - BVH::X_POSITION];
+        continue;
+      }
+
+      // the joint's axes before any of its rotations, each
+      // rotation channel turns the axes of the ones after it
+      if(c == 0 || ik.columnJoints[c - 1] != joint || skeleton.channelType[ik.channels[c - 1]] >= BVH::X_POSITION)
+      {
+        int parent = skeleton.parent[joint];
+        turned = parent >= 0 ? glm::dmat3(glm::mat3(ik.globalMatrices[parent])) : glm::dmat3(1.);
+      }
+      axes[c] = turned[type];
+      pivots[c] = glm::dvec3(ik.globalMatrices[joint][3]);
+      turned = turned * glm::mat3_cast(glm::angleAxis(glm::radians(data[channel]), unitAxes[type]));
+    }
+
+    // A rotation column is its axis crossed with the arm out to the moved
+    // joint, how far that joint moves per radian. Position columns move it
+    // one unit per unit, scaled to match the steps coming out in degrees.
+    jacobian.setZero(numRows, numColumns);
+    for(int j = 0; j < numJoints; j++)
+    {
+      for(int e = ik.effectorStart[j]; e < ik.effectorStart[j + 1]; e++)
+      {
+        int c = ik.effectorColumns[e];
+        bool isPosition = skeleton.channelType[ik.channels[c]] >= BVH::X_POSITION;
+        glm::dvec3 change = isPosition ? axes[c] / IK_STEP_SCALE : glm::cross(axes[c], ik.effectors[j] - pivots[c]);
+        for(int a = 0; a < 3; a++){ jacobian((3 * j) + a, c) = change[a]; }
+      }
+    }
+  }
+
+  // what Derive left, moved joints' rows by channels' columns
+  const Eigen::MatrixXd & Jacobian() const { return jacobian; }
+
+private:
+  // kept between steps so dragging doesn't allocate
+  std::vector<glm::dvec3> axes;             // each column's axis in the scene
+  std::vector<glm::dvec3> pivots;           // and the point it turns about
+  Eigen::MatrixXd jacobian;
+  Eigen::MatrixXd system;                   // J J^T + lambda^2 I
+  Eigen::LDLT<Eigen::MatrixXd> factor;
+  Eigen::VectorXd target;
+  Eigen::VectorXd solve;
+  Eigen::VectorXd step;
+  Eigen::VectorXd control;
+  Eigen::VectorXd scale;                    // square root weights, 0 once held at a limit
+  Eigen::VectorXd held;                     // the steps of columns held at a limit
+  Eigen::VectorXd residual;                 // the target less what those steps do
+  Eigen::MatrixXd scaled;                   // jacobian with scale applied
+};
+
+////////////////
+// CCD
+////////////////
+
+// Works up from each moved joint's parent to the root, turning each
+// joint so the moved joint lies on the line from it to the goal. A
+// joint only moves what is below it, so the effector is followed
+// along without running forward kinematics for every joint.
+class CCDSolver : public IKSolver
+{
+public:
+  const char * Name() const { return "CCD"; }
+
+  void Step(const BVH & bvh, IKWorkspace & ik, double * data)
+  {
+    const Skeleton & skeleton = bvh.skeleton;
+    int numEffectors = ik.joints.size();
+
+    for(int i = 0; i < numEffectors; i++)
+    {
+      int effectorJoint = ik.joints[i];
+
+      // the joints moved for the last effector may be this one's too
+      if(i > 0){ ik.Pose(skeleton, data); }
+      if(skeleton.parent[effectorJoint] < 0)
+      {
+        MoveRoot(bvh, ik, i, data);
+        continue;
+      }
+
+      glm::dvec3 effector = glm::dvec3(ik.globalMatrices[effectorJoint][3]);
+      glm::dvec3 goal = ik.goals[i];
+
+      for(int j = skeleton.parent[effectorJoint]; j >= 0; j = skeleton.parent[j])
+      {
+        if(!CanTurn(bvh, j)){ continue; }
+
+        glm::dvec3 position = glm::dvec3(ik.globalMatrices[j][3]);
+        glm::dvec3 toEffector = effector - position;
+        glm::dvec3 toGoal = goal - position;
+        if(glm::length(toEffector) < IK_MIN_LENGTH || glm::length(toGoal) < IK_MIN_LENGTH){ continue; }
+
+        // only what is below j has moved so far, so j and its parent
+        // still face the same way. Lighter joints turn part of the way.
+        glm::dquat identity = glm::dquat(1., 0., 0., 0.);
+        glm::dquat turn = glm::slerp(identity, RotationBetween(toEffector, toGoal), std::min(bvh.ikLimits[j].weight, 1.));
+        glm::dquat parent = WorldRotation(ik, skeleton.parent[j]);
+        glm::dquat world = WorldRotation(ik, j);
+        glm::dquat local = SetLocalRotation(bvh, j, glm::inverse(parent) * turn * world, data);
+
+        // as far as the limits let it
+        turn = parent * local * glm::inverse(world);
+        effector = position + turn * toEffector;
+      }
+    }
+  }
+};
+
+////////////////
+// FABRIK
+////////////////
+
+// Forward And Backward Reaching IK. The points of the chain from the
+// root to the moved joint are pulled to the goal and back to the root
+// keeping every bone's length, then each joint from the root down is
+// turned so its bone points where its point went.
+class FABRIKSolver : public IKSolver
+{
+public:
+  const char * Name() const { return "FABRIK"; }
+
+  void Step(const BVH & bvh, IKWorkspace & ik, double * data)
+  {
+    // The points are planned as if every joint could turn any way, so
+    // limits can leave it asking for the same thing step after step.
+    // Once it stops getting closer CCD, which only asks each joint for
+    // what it can do, takes over.
+    if(ik.iterations == 0){ isStalled = false; }
+    else if(ik.error > IK_STALL * lastError){ isStalled = true; }
+    lastError = ik.error;
+    if(isStalled)
+    {
+      ccd.Step(bvh, ik, data);
+      return;
+    }
+
+    const Skeleton & skeleton = bvh.skeleton;
+    int numEffectors = ik.joints.size();
+
+    for(int i = 0; i < numEffectors; i++)
+    {
+      if(i > 0){ ik.Pose(skeleton, data); }
+
+      // root first
+      chain.clear();
+      for(int j = ik.joints[i]; j >= 0; j = skeleton.parent[j]){ chain.push_back(j); }
+      std::reverse(chain.begin(), chain.end());
+
+      int numPoints = chain.size();
+      if(numPoints < 2)
+      {
+        MoveRoot(bvh, ik, i, data);
+        continue;
+      }
+
+      points.resize(numPoints);
+      moved.resize(numPoints);
+      lengths.resize(numPoints - 1);
+      for(int k = 0; k < numPoints; k++)
+      {
+        points[k] = glm::dvec3(ik.globalMatrices[chain[k]][3]);
+        if(k > 0){ lengths[k - 1] = glm::length(points[k] - points[k - 1]); }
+      }
+
+      glm::dvec3 goal = ik.goals[i];
+      moved = points;
+      Plan(0, goal);
+
+      // Turning a joint turns everything below it as well, turned
+      // is what the joints above have done to this one so far. When
+      // a limit stops a joint short, the rest of the chain is planned
+      // again from where it really got to.
+      glm::dquat turned = glm::dquat(1., 0., 0., 0.);
+      glm::dquat parentWorld = WorldRotation(ik, skeleton.parent[chain[0]]);
+      glm::dvec3 position = points[0];
+      for(int k = 0; k + 1 < numPoints; k++)
+      {
+        int j = chain[k];
+        glm::dquat original = WorldRotation(ik, j);
+        glm::dquat world = turned * original;
+        glm::dvec3 bone = turned * (points[k + 1] - points[k]);
+        glm::dvec3 wanted = moved[k + 1] - position;
+
+        if(CanTurn(bvh, j) && glm::length(bone) > IK_MIN_LENGTH && glm::length(wanted) > IK_MIN_LENGTH)
+        {
+          // as far as the limits let it
+          glm::dquat turn = RotationBetween(bone, wanted);
+          world = parentWorld * SetLocalRotation(bvh, j, glm::inverse(parentWorld) * turn * world, data);
+          turned = world * glm::inverse(original);
+        }
+        parentWorld = world;
+        position += turned * (points[k + 1] - points[k]);
+
+        if(k + 2 < numPoints && glm::length(position - moved[k + 1]) > IK_MIN_LENGTH)
+        {
+          moved[k + 1] = position;
+          Plan(k + 1, goal);
+        }
+      }
+    }
+  }
+
+private:
+  // Moves the points after moved[from] to reach for goal, keeping
+  // every bone's length
+  void Plan(int from, const glm::dvec3 & goal)
+  {
+    int numPoints = moved.size();
+    glm::dvec3 base = moved[from];
+    double reach = 0.;
+    for(int k = from; k + 1 < numPoints; k++){ reach += lengths[k]; }
+
+    if(glm::length(goal - base) >= reach)
+    {
+      // out of reach, straighten the chain towards it
+      glm::dvec3 direction = glm::normalize(goal - base);
+      for(int k = from + 1; k < numPoints; k++){ moved[k] = moved[k - 1] + direction * lengths[k - 1]; }
+      return;
+    }
+
+    // back from the goal, then forward from the base
+    moved[numPoints - 1] = goal;
+    for(int k = numPoints - 2; k > from; k--){ moved[k] = Along(moved[k + 1], moved[k], lengths[k]); }
+    for(int k = from + 1; k < numPoints; k++){ moved[k] = Along(moved[k - 1], moved[k], lengths[k - 1]); }
+  }
+
+  // the point length along the line from anchor through towards
+  static glm::dvec3 Along(const glm::dvec3 & anchor, const glm::dvec3 & towards, double length)
+  {
+    glm::dvec3 direction = towards - anchor;
+    double distance = glm::length(direction);
+    if(distance < IK_MIN_LENGTH){ return anchor; }
+    return anchor + direction * (length / distance);
+  }
+
+  CCDSolver ccd;
+  bool isStalled;
+  double lastError;
+
+  // kept between steps so dragging doesn't allocate
+  std::vector<int> chain;
+  std::vector<glm::dvec3> points;
+  std::vector<glm::dvec3> moved;
+  std::vector<double> lengths;
+};
+
+IKSolver * CreateIKSolver(int type)
+{
+  switch(type)
+  {
+    case IK_JACOBIAN: return new JacobianSolver();
+    case IK_CCD:      return new CCDSolver();
+    case IK_FABRIK:   return new FABRIKSolver();
+  }
+  return NULL;
+}
+
+void IKJacobian(const BVH & bvh, const IKWorkspace & ik, const double * data, std::vector<double> & jacobian)
+{
+  JacobianSolver solver;
+  solver.Derive(bvh, ik, data);
+
+  // the solver's columns are per radian, or per degree's worth of units
+  const Eigen::MatrixXd & derived = solver.Jacobian();
+  jacobian.resize(derived.size());
+  for(int r = 0; r < derived.rows(); r++)
+  {
+    for(int c = 0; c < derived.cols(); c++){ jacobian[(long)r * derived.cols() + c] = derived(r, c) * IK_STEP_SCALE; }
+  }
+}
+
+IKLimits::IKLimits()
+{
+  for(int a = 0; a < 3; a++)
+  {
+    lower[a] = -HUGE_VAL;
+    upper[a] = HUGE_VAL;
+  }
+  weight = 1.;
+}
+
+IKWorkspace::IKWorkspace()
+{
+  solver = NULL;
+  solverType = -1;
+  iterations = 0;
+  error = 0.;
+}
+
+IKWorkspace::~IKWorkspace()
+{
+  delete solver;
+}
+
+bool IKWorkspace::SetSolver(int type)
+{
+  IKSolver * created = CreateIKSolver(type);
+  if(created == NULL){ return false; }
+
+  delete solver;
+  solver = created;
+  solverType = type;
+  return true;
+}
+
+// Only channels turning an ancestor of a moved joint can move it,
+// so each of those gets a column, the Jacobian's own, and each moved
+// joint only gets entries in its own ancestors' columns. The root's
+// position channels join in when the root is moved or ikTranslationWeight
+// lets the body shift.
+void IKWorkspace::BuildChain(const BVH & bvh)
+{
+  const Skeleton & skeleton = bvh.skeleton;
+  int numJoints = joints.size();
+  columns.assign(bvh.numChannel, -1);
+  channels.clear();
+  columnJoints.clear();
+  lower.clear();
+  upper.clear();
+  weights.clear();
+  effectorColumns.clear();
+  effectorStart.clear();
+  effectorRoots.resize(numJoints);
+
+  // Moving a root moves every joint under it the same way. A file can
+  // have more than one ROOT, so each joint keeps the one above it.
+  bool isRootMoved = false;
+  for(int i = 0; i < numJoints; i ++)
+  {
+    int root = joints[i];
+    while(skeleton.parent[root] >= 0){ root = skeleton.parent[root]; }
+    effectorRoots[i] = root;
+    if(joints[i] == root){ isRootMoved = true; }
+  }
+  double translationWeight = bvh.ikTranslationWeight > 0. ? bvh.ikTranslationWeight : (isRootMoved ? 1. : 0.);
+
+  for(int i = 0; i < numJoints; i ++)
+  {
+    effectorStart.push_back(effectorColumns.size());
+    for(int j = joints[i]; j >= 0; j = skeleton.parent[j])
+    {
+      int count = skeleton.rotationCount[j];
+      bool isTranslated = j == effectorRoots[i] && translationWeight > 0.;
+      for(int k = 0; k < count + (isTranslated ? 3 : 0); k++)
+      {
+        int channel = k < count ? skeleton.rotationChannel[3 * j + k] : skeleton.positionChannel[3 * j + k - count];
+        if(channel < 0){ continue; }
+
+        if(columns[channel] < 0)
+        {
+          columns[channel] = channels.size();
+          channels.push_back(channel);
+          columnJoints.push_back(j);
+
+          int axis = skeleton.channelType[channel];
+          lower.push_back(k < count ? bvh.ikLimits[j].lower[axis] : -HUGE_VAL);
+          upper.push_back(k < count ? bvh.ikLimits[j].upper[axis] : HUGE_VAL);
+          weights.push_back(k < count ? bvh.ikLimits[j].weight : translationWeight);
+        }
+        effectorColumns.push_back(columns[channel]);
+      }
+    }
+  }
+  effectorStart.push_back(effectorColumns.size());
+}
+
+void IKWorkspace::Pose(const Skeleton & skeleton, const double * data)
+{
+  localMatrices.resize(skeleton.numJoints);
+  globalMatrices.resize(skeleton.numJoints);
+  skeleton.ForwardKinematics(data, localMatrices.data(), globalMatrices.data());
+}
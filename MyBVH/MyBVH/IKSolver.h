@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	IKSolver.h
+//	------------------------
+//
+//	The ways MoveJoint can bring dragged joints
+//	towards where they were dragged to
+//
+///////////////////////////////////////////////////
+
+#ifndef _IK_SOLVER_H_
+#define _IK_SOLVER_H_
+
+#include <vector>
+#include "glm.hpp"
+
+class BVH;
+class IKSolver;
+struct Skeleton;
+
+// Which IKSolver MoveJoint uses
+enum IKSolverType
+{
+  IK_JACOBIAN,    // damped least squares over every channel in the chains at once
+  IK_CCD,         // cyclic coordinate descent, one joint at a time from the end
+  IK_FABRIK,      // moves the chain's points, then turns the joints to match
+  IK_SOLVER_COUNT
+};
+
+// How far IK may turn one joint about each of its x, y and z axes,
+// in degrees of the joint's own channels, and how readily it turns
+// compared to the rest of the chain. A weight of 0 holds it still.
+struct IKLimits
+{
+  IKLimits();
+
+  double lower[3];
+  double upper[3];
+  double weight;
+};
+
+// Everything one solve works on, the settings stay in the BVH. Dragging
+// uses bvh.ik and SolveClipIK gives each worker its own, so frames can
+// be solved at once. Kept between calls so once their sizes settle
+// solving doesn't allocate anything.
+struct IKWorkspace
+{
+  IKWorkspace();
+  ~IKWorkspace();
+
+  // owns its solver, which has buffers of its own
+  IKWorkspace(const IKWorkspace &) = delete;
+  IKWorkspace & operator=(const IKWorkspace &) = delete;
+
+  // swaps in a new solver of type, false if there isn't one
+  bool SetSolver(int type);
+
+  // forward kinematics of data into the matrices below
+  void Pose(const Skeleton & skeleton, const double * data);
+
+  // finds the channels that can move the joints, with their limits
+  void BuildChain(const BVH & bvh);
+
+  IKSolver * solver;
+  int solverType;
+
+  std::vector<int> joints;                  // the moved joints
+  std::vector<glm::dvec3> goals;            // where each is going
+  std::vector<glm::dvec3> effectors;        // and where it is
+  std::vector<int> channels;                // the channels that can move them, a column each
+  std::vector<int> columns;                 // numChannel, each channel's column or -1
+  std::vector<int> columnJoints;            // the joint each column's channel belongs to
+  std::vector<int> effectorColumns;         // the columns that move each joint, one after another
+  std::vector<int> effectorStart;           // where each joint's start, and one past the last
+  std::vector<int> effectorRoots;           // the root above each joint
+  std::vector<double> best;                 // each column's channel when it was closest
+  std::vector<double> lower;                // each column's limits
+  std::vector<double> upper;
+  std::vector<double> weights;              // and its joint's weight
+  std::vector<glm::mat4> localMatrices;     // every joint, from Pose
+  std::vector<glm::mat4> globalMatrices;
+
+  // how the last solve went, the furthest any joint ended up from its goal
+  int iterations;
+  double error;
+};
+
+// SolveIK builds the workspace's chain, fills in its effectors and
+// matrices from forward kinematics of data, then calls Step until the joints are
+// close enough or it runs out of steps or time. Solvers only read the
+// BVH, so several can run on one at once with their own workspaces.
+class IKSolver
+{
+public:
+  virtual ~IKSolver() {}
+
+  virtual const char * Name() const = 0;
+
+  // one step bringing every moved joint closer to its goal, by editing data
+  virtual void Step(const BVH & bvh, IKWorkspace & ik, double * data) = 0;
+};
+
+// a new solver of type, NULL if there isn't one
+IKSolver * CreateIKSolver(int type);
+
+// How far each of ik's moved joints moves per degree, or unit, of each
+// of its chain's channels, as the Jacobian solver works it out from
+// ik.effectors and ik's matrices posed from data. Three rows a joint,
+// one after another, of a value per column.
+void IKJacobian(const BVH & bvh, const IKWorkspace & ik, const double * data, std::vector<double> & jacobian);
+
+#endif
@@ -0,0 +1,217 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	KeyframeSplines.cpp
+//	------------------------
+//
+//	Curves through the keyframes of every channel,
+//	any frame can be found without baking the clip
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstring>
+#include "KeyframeSplines.h"
+
+KeyframeSplines::KeyframeSplines()
+{
+  numChannel = 0;
+}
+
+void KeyframeSplines::Resize(int numChannel)
+{
+  this->numChannel = numChannel;
+
+  frames.clear();
+  values.clear();
+  inTangents.clear();
+  outTangents.clear();
+  tangentsValid.clear();
+
+  curve.assign(numChannel, CURVE_CATMULL_ROM);
+  tension.assign(numChannel, 0.);
+  continuity.assign(numChannel, 0.);
+  bias.assign(numChannel, 0.);
+}
+
+bool KeyframeSplines::SetCurve(int channel, int curve)
+{
+  if(this->curve[channel] == curve){ return false; }
+
+  this->curve[channel] = curve;
+  std::fill(tangentsValid.begin(), tangentsValid.end(), 0);
+  return true;
+}
+
+bool KeyframeSplines::SetTCB(int channel, double tension, double continuity, double bias)
+{
+  if(this->tension[channel] == tension && this->continuity[channel] == continuity &&
+     this->bias[channel] == bias){ return false; }
+
+  this->tension[channel] = tension;
+  this->continuity[channel] = continuity;
+  this->bias[channel] = bias;
+
+  // only TCB curves use them, SetCurve clears the tangents when one turns into TCB
+  if(curve[channel] != CURVE_TCB){ return false; }
+
+  std::fill(tangentsValid.begin(), tangentsValid.end(), 0);
+  return true;
+}
+
+bool KeyframeSplines::SameKeys(const std::vector<int> & keyFrames) const
+{
+  return keyFrames == frames;
+}
+
+void KeyframeSplines::SetKeys(const std::vector<int> & keyFrames, const double * motion)
+{
+  int numKeys = keyFrames.size();
+  frames = keyFrames;
+  values.resize((long)numKeys * numChannel);
+  inTangents.resize(values.size());
+  outTangents.resize(values.size());
+  tangentsValid.assign(numKeys, 0);
+
+  for(int k = 0; k < numKeys; k++)
+  {
+    memcpy(&values[(long)k * numChannel], motion + (long)frames[k] * numChannel, numChannel * sizeof(double));
+  }
+}
+
+void KeyframeSplines::UpdateKey(int k, const double * frame)
+{
+  double * key = &values[(long)k * numChannel];
+  if(memcmp(key, frame, numChannel * sizeof(double)) == 0){ return; }
+
+  memcpy(key, frame, numChannel * sizeof(double));
+
+  // a key's tangents come from the keys either side of it
+  for(int n = std::max(k - 1, 0); n <= std::min(k + 1, NumKeys() - 1); n++){ tangentsValid[n] = 0; }
+}
+
+void KeyframeSplines::UpdateTangents(int k)
+{
+  int numKeys = NumKeys();
+  const double * key = &values[(long)k * numChannel];
+  const double * before = k > 0 ? key - numChannel : 0;
+  const double * after = k + 1 < numKeys ? key + numChannel : 0;
+  double * in = &inTangents[(long)k * numChannel];
+  double * out = &outTangents[(long)k * numChannel];
+
+  // frames to the keys either side, keys needn't be evenly spaced
+  double spanBefore = before ? frames[k] - frames[k - 1] : 0.;
+  double spanAfter = after ? frames[k + 1] - frames[k] : 0.;
+
+  for(int c = 0; c < numChannel; c++)
+  {
+    // slopes of the straight lines to the keys either side, the
+    // end keys just carry on along the only one they have
+    double slopeBefore = before ? (key[c] - before[c]) / spanBefore : 0.;
+    double slopeAfter = after ? (after[c] - key[c]) / spanAfter : 0.;
+    if(!before){ slopeBefore = slopeAfter; }
+    if(!after){ slopeAfter = slopeBefore; }
+
+    switch(curve[c])
+    {
+      case CURVE_LINEAR:
+        in[c] = slopeBefore;
+        out[c] = slopeAfter;
+        break;
+
+      case CURVE_CATMULL_ROM:
+        // the line from the key before to the key after
+        if(before && after)
+        {
+          in[c] = out[c] = (after[c] - before[c]) / (spanBefore + spanAfter);
+        }
+        else
+        {
+          in[c] = out[c] = before ? slopeBefore : slopeAfter;
+        }
+        break;
+
+      case CURVE_TCB:
+      {
+        // Kochanek-Bartels, all three at 0 is an even blend of the two slopes
+        double t = 1. - tension[c], cMinus = 1. - continuity[c], cPlus = 1. + continuity[c];
+        double bMinus = 1. - bias[c], bPlus = 1. + bias[c];
+        in[c] = 0.5 * t * (cMinus * bPlus * slopeBefore + cPlus * bMinus * slopeAfter);
+        out[c] = 0.5 * t * (cPlus * bPlus * slopeBefore + cMinus * bMinus * slopeAfter);
+        break;
+      }
+    }
+  }
+  tangentsValid[k] = 1;
+}
+
+void KeyframeSplines::UpdateTangents()
+{
+  for(int k = 0; k < NumKeys(); k++)
+  {
+    if(!tangentsValid[k]){ UpdateTangents(k); }
+  }
+}
+
+int KeyframeSplines::FindSpan(double frame) const
+{
+  // last key at or before frame
+  int k = std::upper_bound(frames.begin(), frames.end(), frame) - frames.begin() - 1;
+  return std::max(0, std::min(k, NumKeys() - 2));
+}
+
+void KeyframeSplines::EvaluateSpan(int k, double frame, double * out) const
+{
+  const double * p0 = &values[(long)k * numChannel];
+  const double * p1 = p0 + numChannel;
+  const double * m0 = &outTangents[(long)k * numChannel];
+  const double * m1 = &inTangents[(long)(k + 1) * numChannel];
+
+  // cubic Hermite basis, the tangents are per frame so scale them to the span
+  double span = frames[k + 1] - frames[k];
+  double u = (frame - frames[k]) / span;
+  double u2 = u * u, u3 = u2 * u;
+  double h00 = 2. * u3 - 3. * u2 + 1.;
+  double h10 = (u3 - 2. * u2 + u) * span;
+  double h01 = -2. * u3 + 3. * u2;
+  double h11 = (u3 - u2) * span;
+  double lerp0 = 1. - u, lerp1 = u;
+
+  for(int c = 0; c < numChannel; c++)
+  {
+    if(curve[c] == CURVE_LINEAR)
+    {
+      out[c] = lerp0 * p0[c] + lerp1 * p1[c];
+    }
+    else
+    {
+      out[c] = h00 * p0[c] + h10 * m0[c] + h01 * p1[c] + h11 * m1[c];
+    }
+  }
+}
+
+void KeyframeSplines::Evaluate(double frame, double * out)
+{
+  int numKeys = NumKeys();
+  if(numKeys == 0){ return; }
+
+  // held either side of the keys
+  if(numKeys == 1 || frame <= frames[0])
+  {
+    memcpy(out, &values[0], numChannel * sizeof(double));
+    return;
+  }
+  if(frame >= frames[numKeys - 1])
+  {
+    memcpy(out, &values[(long)(numKeys - 1) * numChannel], numChannel * sizeof(double));
+    return;
+  }
+
+  int k = FindSpan(frame);
+  if(!tangentsValid[k]){ UpdateTangents(k); }
+  if(!tangentsValid[k + 1]){ UpdateTangents(k + 1); }
+  EvaluateSpan(k, frame, out);
+}
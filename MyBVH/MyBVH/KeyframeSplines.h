@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	KeyframeSplines.h
+//	------------------------
+//
+//	Curves through the keyframes of every channel,
+//	any frame can be found without baking the clip
+//
+///////////////////////////////////////////////////
+
+#ifndef _KEYFRAME_SPLINES_H_
+#define _KEYFRAME_SPLINES_H_
+
+#include <vector>
+
+// The curve a channel follows between its keys
+enum CurveType
+{
+  CURVE_LINEAR,         // straight lines, the same as the Euler lerp
+  CURVE_CATMULL_ROM,    // passes through every key smoothly
+  CURVE_TCB             // Kochanek-Bartels, Catmull-Rom with tension, continuity and bias
+};
+
+// Hermite curves through the key values of every channel. Tangents
+// are worked out when first needed and kept until one of the keys
+// they depend on changes. Values and tangents are stored key by key,
+// numChannel at a time, so a frame only reads the two keys around it.
+class KeyframeSplines
+{
+public:
+  KeyframeSplines();
+
+  // numChannel channels, all Catmull-Rom, and no keys
+  void Resize(int numChannel);
+
+  // true if anything changed, which means every span needs redoing
+  bool SetCurve(int channel, int curve);
+  // only true for a TCB channel, the others keep the numbers for later
+  bool SetTCB(int channel, double tension, double continuity, double bias);
+
+  // takes the keys and their values from motion, when keys are added or removed
+  bool SameKeys(const std::vector<int> & keyFrames) const;
+  void SetKeys(const std::vector<int> & keyFrames, const double * motion);
+
+  // the k'th key's values are now frame, only its tangents and
+  // its neighbours' are thrown away, and only if it really changed
+  void UpdateKey(int k, const double * frame);
+
+  // works out any tangents that have been thrown away
+  void UpdateTangents();
+
+  // the span frame falls in, clamped to the first and last, in O(log keys)
+  int FindSpan(double frame) const;
+
+  // every channel at frame, which lies in span k. UpdateTangents first.
+  void EvaluateSpan(int k, double frame, double * out) const;
+
+  // every channel at any frame, before the first key and
+  // after the last the end keys are held
+  void Evaluate(double frame, double * out);
+
+  int NumKeys() const { return frames.size(); }
+
+  int numChannel;
+
+private:
+  void UpdateTangents(int k);
+
+  std::vector<int> frames;
+  std::vector<double> values;          // [key][channel]
+  std::vector<double> inTangents;      // per frame, arriving at the key
+  std::vector<double> outTangents;     // per frame, leaving the key
+  std::vector<unsigned char> tangentsValid;
+
+  // per channel
+  std::vector<unsigned char> curve;
+  std::vector<double> tension;
+  std::vector<double> continuity;
+  std::vector<double> bias;
+};
+
+#endif
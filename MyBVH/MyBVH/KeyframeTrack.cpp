@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	KeyframeTrack.cpp
+//	------------------------
+//
+//	The keyframes of a clip in order, remembering
+//	which spans between them need lerping again
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cassert>
+#include "KeyframeTrack.h"
+
+KeyframeTrack::KeyframeTrack()
+{
+}
+
+int KeyframeTrack::LowerBound(int frame) const
+{
+  return std::lower_bound(keys.begin(), keys.end(), frame) - keys.begin();
+}
+
+int KeyframeTrack::Previous(int frame) const
+{
+  int k = LowerBound(frame);
+  return k > 0 ? keys[k - 1] : -1;
+}
+
+int KeyframeTrack::Next(int frame) const
+{
+  int k = LowerBound(frame + 1);
+  return k < (int)keys.size() ? keys[k] : -1;
+}
+
+void KeyframeTrack::Range(int first, int last, int & begin, int & end) const
+{
+  begin = LowerBound(first);
+  end = std::max(begin, LowerBound(last + 1));
+}
+
+void KeyframeTrack::SetKey(int frame, bool key)
+{
+  assert(frame >= 0);
+  if(frame >= (int)isKey.size()){ isKey.resize(frame + 1, false); }
+  isKey[frame] = key;
+}
+
+bool KeyframeTrack::Add(int frame)
+{
+  // frames come straight from the GUI and bvhtool
+  if(frame < 0){ return false; }
+
+  int k = LowerBound(frame);
+  if(k < (int)keys.size() && keys[k] == frame){ return false; }
+
+  SetKey(frame, true);
+  keys.insert(keys.begin() + k, frame);
+  dirty.insert(dirty.begin() + k, 1);
+
+  // the span that used to run across it is now two
+  if(k > 0){ dirty[k - 1] = 1; }
+  return true;
+}
+
+bool KeyframeTrack::Remove(int frame)
+{
+  int k = LowerBound(frame);
+  if(k == (int)keys.size() || keys[k] != frame){ return false; }
+
+  isKey[frame] = false;
+  keys.erase(keys.begin() + k);
+  dirty.erase(dirty.begin() + k);
+
+  // the spans either side join up
+  if(k > 0){ dirty[k - 1] = 1; }
+  return true;
+}
+
+void KeyframeTrack::Clear()
+{
+  keys.clear();
+  dirty.clear();
+  isKey.clear();
+}
+
+void KeyframeTrack::Changed(int frame)
+{
+  int k = LowerBound(frame);
+  bool isKey = k < (int)keys.size() && keys[k] == frame;
+
+  // the span before, frames inside a span count as part of it
+  if(k > 0 && k < (int)keys.size()){ dirty[k - 1] = 1; }
+
+  // and a key starts the one after
+  if(isKey){ dirty[k] = 1; }
+}
+
+void KeyframeTrack::InsertFrames(int at, int count)
+{
+  int k = LowerBound(at + 1);
+  for(int i = k; i < (int)keys.size(); i++){ isKey[keys[i]] = false; }
+  for(int i = k; i < (int)keys.size(); i++)
+  {
+    keys[i] += count;
+    SetKey(keys[i], true);
+  }
+
+  // a span the new frames landed in is longer now
+  if(k > 0 && k < (int)keys.size()){ dirty[k - 1] = 1; }
+}
+
+void KeyframeTrack::SetAllDirty()
+{
+  std::fill(dirty.begin(), dirty.end(), 1);
+}
+
+void KeyframeTrack::TakeDirtySpans(std::vector<int> & spans)
+{
+  spans.clear();
+
+  // the last key doesn't start a span
+  for(int k = 0; k + 1 < (int)keys.size(); k++)
+  {
+    if(dirty[k]){ spans.push_back(k); }
+  }
+  std::fill(dirty.begin(), dirty.end(), 0);
+}
@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	KeyframeTrack.h
+//	------------------------
+//
+//	The keyframes of a clip in order, remembering
+//	which spans between them need lerping again
+//
+///////////////////////////////////////////////////
+
+#ifndef _KEYFRAME_TRACK_H_
+#define _KEYFRAME_TRACK_H_
+
+#include <vector>
+
+// Span k runs from key k to key k + 1. A span is dirty when either
+// key, or a frame inside it, has changed since it was last lerped,
+// so LerpKeyframes only redoes the spans an edit actually touched.
+// A bit per frame alongside the sorted keys answers Contains without
+// a search, since it is asked for every time the figure is drawn.
+class KeyframeTrack
+{
+public:
+  KeyframeTrack();
+
+  // number of keys, and the frame of the i'th in order
+  int Count() const { return keys.size(); }
+  int operator[](int i) const { return keys[i]; }
+  const std::vector<int> & Keys() const { return keys; }
+
+  bool Contains(int frame) const { return frame >= 0 && frame < (int)isKey.size() && isKey[frame]; }
+
+  // nearest key before or after frame, not frame itself, -1 if there isn't one
+  int Previous(int frame) const;
+  int Next(int frame) const;
+
+  // keys begin to end - 1 are the ones from frame first to last
+  void Range(int first, int last, int & begin, int & end) const;
+
+  // false if frame was already, or wasn't, a key, or is before the clip
+  bool Add(int frame);
+  bool Remove(int frame);
+  void Clear();
+
+  // frame has been edited, every span it is part of needs redoing
+  void Changed(int frame);
+
+  // count frames were put in just after frame at, so later keys move up
+  void InsertFrames(int at, int count);
+
+  // every span, for when the whole clip has changed
+  void SetAllDirty();
+
+  // the dirty spans, by their first key, and forgets them
+  void TakeDirtySpans(std::vector<int> & spans);
+
+private:
+  // index of the first key at or after frame
+  int LowerBound(int frame) const;
+  void SetKey(int frame, bool key);
+
+  std::vector<int> keys;
+  std::vector<unsigned char> dirty;   // one per key, the span it starts
+  std::vector<bool> isKey;            // one per frame, up to the last key
+};
+
+#endif
@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	MappedFile.cpp
+//	------------------------
+//
+//	Maps a whole file into memory so it can be
+//	parsed in place without copying it line by line
+//
+///////////////////////////////////////////////////
+
+#include <cstdio>
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile()
+{
+  data = NULL;
+  size = 0;
+  isMapped = false;
+}
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+bool MappedFile::Open(const char * fileName)
+{
+  // just make sure nothing is left over
+  Close();
+
+#ifndef _WIN32
+  int fd = open(fileName, O_RDONLY);
+  if(fd < 0){ return false; }
+
+  struct stat info;
+  if(fstat(fd, &info) != 0){ close(fd); return false; }
+
+  // nothing to map, but the file did open
+  if(info.st_size == 0){ close(fd); return true; }
+
+  void * mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  // the mapping keeps its own reference to the file
+  close(fd);
+  if(mapped == MAP_FAILED){ return false; }
+
+  // we read front to back, so let the kernel read ahead
+  madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+
+  data = (const char *)mapped;
+  size = info.st_size;
+  isMapped = true;
+  return true;
+#else
+  // no mmap here, so fall back to a single read into the heap
+  FILE * file = fopen(fileName, "rb");
+  if(file == NULL){ return false; }
+
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  if(length > 0)
+  {
+    char * buffer = new char[length];
+    size = fread(buffer, 1, length, file);
+    data = buffer;
+  }
+  fclose(file);
+  return true;
+#endif
+}
+
+void MappedFile::Close()
+{
+  if(data == NULL){ return; }
+
+#ifndef _WIN32
+  if(isMapped){ munmap((void *)data, size); }
+#else
+  delete[] data;
+#endif
+
+  data = NULL;
+  size = 0;
+  isMapped = false;
+}
+
+void MappedFile::Swap(MappedFile & other)
+{
+  const char * otherData = other.data;
+  size_t otherSize = other.size;
+  bool otherMapped = other.isMapped;
+
+  other.data = data;
+  other.size = size;
+  other.isMapped = isMapped;
+
+  data = otherData;
+  size = otherSize;
+  isMapped = otherMapped;
+}
@@ -0,0 +1,50 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	MappedFile.h
+//	------------------------
+//
+//	Maps a whole file into memory so it can be
+//	parsed in place without copying it line by line
+//
+///////////////////////////////////////////////////
+
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstddef>
+
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+
+  // maps the file read only, returns false if it can't be opened
+  bool Open(const char * fileName);
+
+  // unmaps and forgets the file
+  void Close();
+
+  // hands the mapping over to another MappedFile
+  void Swap(MappedFile & other);
+
+  // start of the mapped bytes (not null terminated)
+  const char * data;
+
+  // how many bytes were mapped
+  size_t size;
+
+private:
+  // we own the mapping so it can't be copied
+  MappedFile(const MappedFile &);
+  MappedFile & operator=(const MappedFile &);
+
+  // true if data came from mmap rather than the heap
+  bool isMapped;
+};
+
+#endif
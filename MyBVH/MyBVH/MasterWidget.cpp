@@ -35,24 +35,51 @@ MasterWidget::MasterWidget(char *filename, QWidget *parent)
     QGroupBox   *saveLoadGroup     = new QGroupBox(tr("Save/Load"));
     QPushButton *loadButton        = new QPushButton("Load", this);
     QPushButton *saveButton        = new QPushButton("Save", this);
+    QLabel      *savePrecisionLabel = new QLabel(tr("Save Decimals: "));
+                 savePrecisionSpinBox = new QSpinBox;
+                 compressMotionCheck = new QCheckBox("Compress Motion");
+                 cacheMotionCheck  = new QCheckBox("Cache Loaded Files");
     QLabel      *addFramesLabel    = new QLabel(tr("Frames: "));
                  addFramesSpinBox  = new QSpinBox;
     QPushButton *newKeyframeButton = new QPushButton("Insert Keyframe", this);
     QPushButton *setKeyframeButton = new QPushButton("Set Keyframe", this);
     QPushButton *lerpKeyframeButton = new QPushButton("Lerp Keyframes", this);
+    QLabel      *interpolationLabel = new QLabel(tr("Lerp Rotations: "));
+                 interpolationComboBox = new QComboBox;
+                 liveLerpCheck      = new QCheckBox("Lerp While Dragging");
     QVBoxLayout *saveLoadLayout    = new QVBoxLayout;
 
     addFramesSpinBox->setRange(0, 1000);
     addFramesSpinBox->setSingleStep(1);
     addFramesSpinBox->setValue(30);
 
+    // -1 shows as exact, every digit needed to read the value back
+    savePrecisionSpinBox->setRange(-1, 9);
+    savePrecisionSpinBox->setSingleStep(1);
+    savePrecisionSpinBox->setValue(-1);
+    savePrecisionSpinBox->setSpecialValueText(tr("Exact"));
+
+    // same order as KeyInterpolation
+    interpolationComboBox->addItem(tr("Euler Angles"));
+    interpolationComboBox->addItem(tr("Slerp"));
+    interpolationComboBox->addItem(tr("Nlerp"));
+    interpolationComboBox->addItem(tr("Catmull-Rom"));
+    interpolationComboBox->setCurrentIndex(0);
+
     saveLoadLayout->addWidget(loadButton);
     saveLoadLayout->addWidget(saveButton);
+    saveLoadLayout->addWidget(savePrecisionLabel);
+    saveLoadLayout->addWidget(savePrecisionSpinBox);
+    saveLoadLayout->addWidget(compressMotionCheck);
+    saveLoadLayout->addWidget(cacheMotionCheck);
     saveLoadLayout->addWidget(addFramesLabel);
     saveLoadLayout->addWidget(addFramesSpinBox);
     saveLoadLayout->addWidget(newKeyframeButton);
     saveLoadLayout->addWidget(setKeyframeButton);
+    saveLoadLayout->addWidget(interpolationLabel);
+    saveLoadLayout->addWidget(interpolationComboBox);
     saveLoadLayout->addWidget(lerpKeyframeButton);
+    saveLoadLayout->addWidget(liveLerpCheck);
     saveLoadGroup ->setLayout(saveLoadLayout);
 
 
@@ -61,6 +88,8 @@ MasterWidget::MasterWidget(char *filename, QWidget *parent)
                  toggleIKCheck        = new QCheckBox();
                  toggleDampeningCheck = new QCheckBox();
                  toggleControlCheck   = new QCheckBox();
+    QLabel      *ikSolverLabel        = new QLabel(tr("Solver"));
+                 ikSolverComboBox     = new QComboBox;
                  lamdbaSpinBox        = new QSpinBox();
     QLabel      *lambdaSpinBoxLabel   = new QLabel(tr("Lambda"));
                  xGainSpinBox         = new QSpinBox();
@@ -69,11 +98,22 @@ MasterWidget::MasterWidget(char *filename, QWidget *parent)
     QLabel      *yGainSpinBoxLabel    = new QLabel(tr("Y Gain"));
                  zGainSpinBox         = new QSpinBox();
     QLabel      *zGainSpinBoxLabel    = new QLabel(tr("Z Gain"));
+                 ikIterationsSpinBox  = new QSpinBox();
+    QLabel      *ikIterationsLabel    = new QLabel(tr("Iterations"));
+                 ikToleranceSpinBox   = new QDoubleSpinBox();
+    QLabel      *ikToleranceLabel     = new QLabel(tr("Tolerance"));
+                 ikBudgetSpinBox      = new QSpinBox();
+    QLabel      *ikBudgetLabel        = new QLabel(tr("Time Budget (us)"));
+                 ikReportLabel        = new QLabel(this);
     QVBoxLayout *IKLayout             = new QVBoxLayout;
 
     toggleDampeningCheck ->setText("Dampening");
     toggleControlCheck   ->setText("Control");
     toggleIKCheck        ->setText("Rotations");
+    // same order as IKSolverType
+    ikSolverComboBox     ->addItem(tr("Jacobian"));
+    ikSolverComboBox     ->addItem(tr("CCD"));
+    ikSolverComboBox     ->addItem(tr("FABRIK"));
     lamdbaSpinBox        ->setRange(0, 1000);
     lamdbaSpinBox        ->setSingleStep(1);
     lamdbaSpinBox        ->setValue(1);
@@ -86,10 +126,23 @@ MasterWidget::MasterWidget(char *filename, QWidget *parent)
     zGainSpinBox         ->setRange(0, 1000);
     zGainSpinBox         ->setSingleStep(1);
     zGainSpinBox         ->setValue(1);
+    ikIterationsSpinBox  ->setRange(1, 100);
+    ikIterationsSpinBox  ->setValue(1);
+    ikToleranceSpinBox   ->setRange(0., 10.);
+    ikToleranceSpinBox   ->setDecimals(4);
+    ikToleranceSpinBox   ->setSingleStep(0.001);
+    ikToleranceSpinBox   ->setValue(0.);
+    ikBudgetSpinBox      ->setRange(0, 100000);
+    ikBudgetSpinBox      ->setSingleStep(100);
+    ikBudgetSpinBox      ->setValue(0);
+    ikBudgetSpinBox      ->setSpecialValueText(tr("None"));
+    ikReportLabel        ->setText("Last Move: -");
 
     IKLayout->addWidget(toggleIKCheck);
     IKLayout->addWidget(toggleDampeningCheck);
     IKLayout->addWidget(toggleControlCheck);
+    IKLayout->addWidget(ikSolverLabel);
+    IKLayout->addWidget(ikSolverComboBox);
     IKLayout->addWidget(lambdaSpinBoxLabel);
     IKLayout->addWidget(lamdbaSpinBox);
     IKLayout->addWidget(xGainSpinBoxLabel);
@@ -98,6 +151,13 @@ MasterWidget::MasterWidget(char *filename, QWidget *parent)
     IKLayout->addWidget(yGainSpinBox);
     IKLayout->addWidget(zGainSpinBoxLabel);
     IKLayout->addWidget(zGainSpinBox);
+    IKLayout->addWidget(ikIterationsLabel);
+    IKLayout->addWidget(ikIterationsSpinBox);
+    IKLayout->addWidget(ikToleranceLabel);
+    IKLayout->addWidget(ikToleranceSpinBox);
+    IKLayout->addWidget(ikBudgetLabel);
+    IKLayout->addWidget(ikBudgetSpinBox);
+    IKLayout->addWidget(ikReportLabel);
     IKGroup ->setLayout(IKLayout);
 
     // playback
@@ -193,6 +253,15 @@ MasterWidget::MasterWidget(char *filename, QWidget *parent)
     connect(xGainSpinBox,         SIGNAL(valueChanged(int)), this,      SLOT(xGainUpdate(int)));
     connect(yGainSpinBox,         SIGNAL(valueChanged(int)), this,      SLOT(yGainUpdate(int)));
     connect(zGainSpinBox,         SIGNAL(valueChanged(int)), this,      SLOT(zGainUpdate(int)));
+    connect(ikSolverComboBox,     SIGNAL(currentIndexChanged(int)), this, SLOT(ikSolverUpdate(int)));
+    connect(ikIterationsSpinBox,  SIGNAL(valueChanged(int)), this,      SLOT(ikIterationsUpdate(int)));
+    connect(ikToleranceSpinBox,   SIGNAL(valueChanged(double)), this,   SLOT(ikToleranceUpdate(double)));
+    connect(ikBudgetSpinBox,      SIGNAL(valueChanged(int)), this,      SLOT(ikBudgetUpdate(int)));
+    connect(savePrecisionSpinBox, SIGNAL(valueChanged(int)), this,      SLOT(savePrecisionUpdate(int)));
+    connect(compressMotionCheck,  SIGNAL(toggled(bool)),  this,         SLOT(compressMotionUpdate(bool)));
+    connect(cacheMotionCheck,     SIGNAL(toggled(bool)),  this,         SLOT(cacheMotionUpdate(bool)));
+    connect(interpolationComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(interpolationUpdate(int)));
+    connect(liveLerpCheck,        SIGNAL(toggled(bool)),  this,         SLOT(liveLerpUpdate(bool)));
     connect(rewindButton,         SIGNAL(pressed()),      this,         SLOT(rewind()));
     connect(stopButton,           SIGNAL(pressed()),      this,         SLOT(stop()));
     connect(playButton,           SIGNAL(pressed()),      this,         SLOT(play()));
@@ -261,10 +330,24 @@ void MasterWidget::keyPressEvent(QKeyEvent* event)
     case Qt::Key_E:
       if(renderWidget->paused == true)
       {
-        if(renderWidget->cFrame < renderWidget->bvh->numFrame-1 ){ renderWidget->cFrame += 1; renderWidget->cTime += renderWidget->bvh->interval * 1000; }
+        if(renderWidget->cFrame < renderWidget->bvh->FramesLoaded()-1 ){ renderWidget->cFrame += 1; renderWidget->cTime += renderWidget->bvh->interval * 1000; }
         renderWidget->updateGL();
       }
       break;
+    // Jump To The Keyframe Before
+    case Qt::Key_BracketLeft:
+      if(renderWidget->paused == true)
+      {
+        jumpToFrame(renderWidget->bvh->keyframes.Previous(renderWidget->cFrame));
+      }
+      break;
+    // Jump To The Keyframe After
+    case Qt::Key_BracketRight:
+      if(renderWidget->paused == true)
+      {
+        jumpToFrame(renderWidget->bvh->keyframes.Next(renderWidget->cFrame));
+      }
+      break;
       ////////////////////////////////////////////
       //  AXIS CONSTRAINTS
       ///////////////////////////////////////////
@@ -332,6 +415,16 @@ void MasterWidget::keyReleaseEvent(QKeyEvent* event)
   QWidget::keyReleaseEvent(event);
 }
 
+// moves playback to a frame, -1 when there was no keyframe to go to
+void MasterWidget::jumpToFrame(int frame)
+{
+  if(frame < 0 || frame >= renderWidget->bvh->FramesLoaded()){ return; }
+
+  renderWidget->cFrame = frame;
+  renderWidget->cTime = frame * renderWidget->bvh->interval * 1000;
+  renderWidget->updateGL();
+}
+
 // Zooming in/out
 void MasterWidget::wheelEvent(QWheelEvent* event)
 {
@@ -428,9 +521,17 @@ void MasterWidget::updateText(int frameNo, float playbackSpeed)
   // can't convert to 2dp
   string playback = "Playback Speed: " + std::to_string((float)((int)(playbackSpeed * 100.)) / 100.) + "x";
 
-  currentFrameLabel->setText(QString::fromStdString("Current Frame: " + std::to_string(frameNo + 1)));
+  string current = "Current Frame: " + std::to_string(frameNo + 1);
+  if(renderWidget->bvh->keyframes.Contains(frameNo)){ current += " (Keyframe)"; }
+
+  currentFrameLabel->setText(QString::fromStdString(current));
   playbackSpeedLabel->setText(QString::fromStdString(playback));
   axisConstraintLabel->setText(QString::fromStdString(axis));
+
+  // how the last IK drag went
+  string report = "Last Move: " + std::to_string(renderWidget->bvh->ik.iterations) + " steps, "
+                + std::to_string(renderWidget->bvh->ik.error) + " off";
+  ikReportLabel->setText(QString::fromStdString(report));
 }
 
 // adds a new keyframe to the animation
@@ -447,9 +548,10 @@ void MasterWidget::setKeyframe()
   renderWidget->bvh->SetKeyFrame();
 }
 
-// sets the current frame to be a keyframe
+// fills in the frames between keyframes
 void MasterWidget::lerpKeyframe()
 {
+  renderWidget->bvh->interpolation = renderWidget->interpolation;
   renderWidget->bvh->LerpKeyframes();
 }
 
@@ -531,3 +633,72 @@ void MasterWidget::zGainUpdate(int i)
 {
   renderWidget->bvh->zGain = (float)i;
 }
+
+// IKSolverType for dragging, kept on the render
+// widget so it survives loading a new file
+void MasterWidget::ikSolverUpdate(int i)
+{
+  renderWidget->ikSolver = i;
+  renderWidget->bvh->SetIKSolver(i);
+}
+
+// most IK steps each time a joint is dragged,
+// also kept for the next file loaded
+void MasterWidget::ikIterationsUpdate(int i)
+{
+  renderWidget->ikMaxIterations = i;
+  renderWidget->bvh->ikMaxIterations = i;
+}
+
+// close enough to stop iterating early
+void MasterWidget::ikToleranceUpdate(double d)
+{
+  renderWidget->ikTolerance = d;
+  renderWidget->bvh->ikTolerance = d;
+}
+
+// microseconds IK can take per drag, 0 for no limit
+void MasterWidget::ikBudgetUpdate(int i)
+{
+  renderWidget->ikTimeBudget = i;
+  renderWidget->bvh->ikTimeBudget = i;
+}
+
+// decimal places used when saving, kept on the render
+// widget so it survives loading a new file
+void MasterWidget::savePrecisionUpdate(int i)
+{
+  renderWidget->savePrecision = i;
+}
+
+// keeps this clip, and any loaded after it, as 16 bit samples
+void MasterWidget::compressMotionUpdate(bool checked)
+{
+  renderWidget->compressMotion = checked;
+
+  // a clip still streaming in is compressed by timerUpdate once it is done
+  if(renderWidget->loadingFrames){ return; }
+
+  if(checked){ renderWidget->compressLoadedMotion(); }
+  else       { renderWidget->bvh->Decompress(); }
+}
+
+// writes a .bvhb next to each file loaded from now on,
+// so loading it again is close to free
+void MasterWidget::cacheMotionUpdate(bool checked)
+{
+  renderWidget->useMotionCache = checked;
+}
+
+// KeyInterpolation for lerping keyframes, kept on the
+// render widget so it survives loading a new file
+void MasterWidget::interpolationUpdate(int i)
+{
+  renderWidget->interpolation = i;
+}
+
+// relerps the spans next to a keyframe as it is dragged
+void MasterWidget::liveLerpUpdate(bool checked)
+{
+  renderWidget->liveLerp = checked;
+}
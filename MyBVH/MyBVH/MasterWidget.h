@@ -32,6 +32,7 @@
 #include <QWheelEvent>
 #include <QCoreApplication>
 #include <QCheckBox>
+#include <QComboBox>
 
 class RenderWidget;
 
@@ -51,6 +52,7 @@ public:
 
 private:
     QSlider *createSlider();
+    void jumpToFrame(int frame);
 
     RenderWidget *renderWidget;
     QPushButton  *loadButton;
@@ -59,10 +61,20 @@ private:
     QLabel       *playbackSpeedLabel;
     QLabel       *axisConstraintLabel;
     QSpinBox     *addFramesSpinBox;
+    QSpinBox     *savePrecisionSpinBox;
+    QCheckBox    *compressMotionCheck;
+    QCheckBox    *cacheMotionCheck;
+    QComboBox    *interpolationComboBox;
+    QCheckBox    *liveLerpCheck;
     QSpinBox     *lamdbaSpinBox;
     QSpinBox     *xGainSpinBox;
     QSpinBox     *yGainSpinBox;
     QSpinBox     *zGainSpinBox;
+    QComboBox    *ikSolverComboBox;
+    QSpinBox     *ikIterationsSpinBox;
+    QDoubleSpinBox *ikToleranceSpinBox;
+    QSpinBox     *ikBudgetSpinBox;
+    QLabel       *ikReportLabel;
     QCheckBox    *toggleIKCheck;
     QCheckBox    *toggleDampeningCheck;
     QCheckBox    *toggleControlCheck;
@@ -86,6 +98,15 @@ public slots:
   void xGainUpdate(int i);
   void yGainUpdate(int i);
   void zGainUpdate(int i);
+  void ikSolverUpdate(int i);
+  void ikIterationsUpdate(int i);
+  void ikToleranceUpdate(double d);
+  void ikBudgetUpdate(int i);
+  void savePrecisionUpdate(int i);
+  void compressMotionUpdate(bool checked);
+  void cacheMotionUpdate(bool checked);
+  void interpolationUpdate(int i);
+  void liveLerpUpdate(bool checked);
 
 };
 
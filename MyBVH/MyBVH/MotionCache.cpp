@@ -0,0 +1,246 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	MotionCache.cpp
+//	------------------------
+//
+//	Reading and writing the binary .bvhb cache that
+//	sits next to a .bvh file
+//
+///////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include "BVH.h"
+#include "MappedFile.h"
+#include "MotionCache.h"
+
+uint64_t CacheChecksum(const char * data, size_t size, uint64_t hash)
+{
+  const uint64_t prime = 0x100000001b3ULL;
+  size_t i = 0;
+  for(; i + 8 <= size; i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * prime;
+    hash ^= hash >> 29;
+  }
+  for(; i < size; i++)
+  {
+    hash = (hash ^ (unsigned char)data[i]) * prime;
+  }
+  return hash;
+}
+
+// appends raw bytes to the cache being built
+static void Put(string & out, const void * data, size_t size)
+{
+  out.append((const char *)data, size);
+}
+
+// reads raw bytes back out, false if the file ends first
+static bool Get(const char *& p, const char * end, void * data, size_t size)
+{
+  if((size_t)(end - p) < size){ return false; }
+  memcpy(data, p, size);
+  p += size;
+  return true;
+}
+
+// foo.bvh -> foo.bvhb
+string BVH::CacheFileName(const char * bvhFileName)
+{
+  return string(bvhFileName) + "b";
+}
+
+// the cache is only trusted if it was written after the .bvh
+bool BVH::IsCacheFresh(const char * bvhFileName, const char * cacheFileName)
+{
+  struct stat bvhInfo;
+  struct stat cacheInfo;
+  if(stat(bvhFileName, &bvhInfo) != 0)    { return false; }
+  if(stat(cacheFileName, &cacheInfo) != 0){ return false; }
+  return cacheInfo.st_mtime >= bvhInfo.st_mtime;
+}
+
+bool BVH::SaveCache(const char * cacheFileName)
+{
+  if(!isLoadSuccess || motion == NULL){ return false; }
+
+  struct stat bvhInfo;
+  if(stat(fileName.c_str(), &bvhInfo) != 0){ return false; }
+
+  MotionCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "BVHB", 4);
+  header.version = MOTION_CACHE_VERSION;
+  header.sourceSize = bvhInfo.st_size;
+  header.sourceTime = bvhInfo.st_mtime;
+  header.numJoints = joints.size();
+  header.numChannel = numChannel;
+  header.numFrame = numFrame;
+  header.interval = interval;
+
+  // everything between the header and the motion array
+  string hierarchy;
+  for(size_t i = 0; i < joints.size(); i++)
+  {
+    Joint * joint = joints[i];
+    int32_t parent = joint->parent ? joint->parent->index : -1;
+    uint8_t hasSite = joint->hasSite;
+    uint32_t nameLength = joint->name.size();
+    uint32_t numJointChannels = joint->channels.size();
+
+    Put(hierarchy, &parent, sizeof(parent));
+    Put(hierarchy, joint->offset, sizeof(joint->offset));
+    Put(hierarchy, joint->site, sizeof(joint->site));
+    Put(hierarchy, &hasSite, sizeof(hasSite));
+    Put(hierarchy, &nameLength, sizeof(nameLength));
+    Put(hierarchy, joint->name.data(), nameLength);
+    Put(hierarchy, &numJointChannels, sizeof(numJointChannels));
+    for(size_t c = 0; c < joint->channels.size(); c++)
+    {
+      uint8_t type = joint->channels[c]->type;
+      Put(hierarchy, &type, sizeof(type));
+    }
+  }
+  uint64_t textLength = fileContents.size();
+  Put(hierarchy, &textLength, sizeof(textLength));
+  Put(hierarchy, fileContents.data(), textLength);
+
+  // pad so the motion array can be used in place once mapped
+  while(hierarchy.size() % sizeof(double) != 0){ hierarchy.push_back('\0'); }
+  header.motionOffset = sizeof(header) + hierarchy.size();
+
+  // the motion gets its own checksum so loading needn't read it all
+  size_t motionBytes = (size_t)numFrame * numChannel * sizeof(double);
+  header.motionChecksum = CacheChecksum((const char *)motion, motionBytes);
+  header.checksum = CacheChecksum((const char *)&header, sizeof(header));
+  header.checksum = CacheChecksum(hierarchy.data(), hierarchy.size(), header.checksum);
+
+  // write next to the cache and rename, so a half
+  // written file can never be picked up
+  string tempName = string(cacheFileName) + ".tmp";
+  FILE * file = fopen(tempName.c_str(), "wb");
+  if(file == NULL){ return false; }
+
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(hierarchy.data(), 1, hierarchy.size(), file) == hierarchy.size() &&
+                 fwrite(motion, 1, motionBytes, file) == motionBytes;
+  written = (fclose(file) == 0) && written;
+
+  if(!written || rename(tempName.c_str(), cacheFileName) != 0)
+  {
+    remove(tempName.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool BVH::LoadCache(const char * cacheFileName)
+{
+  // read only, Decompress copies the motion out before any edit
+  MappedFile * file = new MappedFile();
+  if(!file->Open(cacheFileName) || file->size < sizeof(MotionCacheHeader))
+  {
+    delete file;
+    return false;
+  }
+
+  MotionCacheHeader header;
+  memcpy(&header, file->data, sizeof(header));
+
+  const char * p = file->data + sizeof(header);
+  const char * end = file->data + file->size;
+  size_t motionBytes = (size_t)header.numFrame * header.numChannel * sizeof(double);
+
+  // The .bvh this came from must be the same size and age as it was
+  // and the cache the size the header says. Only the header and the
+  // hierarchy are checksummed, reading every frame would cost as much
+  // as the mapping saves, unless verifyMotionCache asks for it.
+  struct stat bvhInfo;
+  uint64_t checksum = header.checksum;
+  header.checksum = 0;
+  bool valid = memcmp(header.magic, "BVHB", 4) == 0 &&
+               header.version == MOTION_CACHE_VERSION &&
+               stat(fileName.c_str(), &bvhInfo) == 0 &&
+               header.sourceSize == (uint64_t)bvhInfo.st_size &&
+               header.sourceTime == (int64_t)bvhInfo.st_mtime &&
+               header.motionOffset % sizeof(double) == 0 &&
+               header.motionOffset >= sizeof(header) &&
+               header.motionOffset + motionBytes == file->size &&
+               CacheChecksum(p, header.motionOffset - sizeof(header), CacheChecksum((const char *)&header, sizeof(header))) == checksum &&
+               (!verifyMotionCache || CacheChecksum(file->data + header.motionOffset, motionBytes) == header.motionChecksum);
+
+  // rebuild the joints and channels in file order
+  for(uint32_t i = 0; valid && i < header.numJoints; i++)
+  {
+    int32_t parent;
+    uint8_t hasSite;
+    uint32_t nameLength;
+    uint32_t numJointChannels;
+    double offset[3];
+    double site[3];
+
+    valid = Get(p, end, &parent, sizeof(parent)) &&
+            Get(p, end, offset, sizeof(offset)) &&
+            Get(p, end, site, sizeof(site)) &&
+            Get(p, end, &hasSite, sizeof(hasSite)) &&
+            Get(p, end, &nameLength, sizeof(nameLength)) &&
+            nameLength <= (size_t)(end - p) &&
+            parent < (int32_t)i;
+    if(!valid){ break; }
+
+    string name(p, nameLength);
+    p += nameLength;
+
+    Joint * joint = AddJoint(parent >= 0 ? joints[parent] : NULL, name);
+    memcpy(joint->offset, offset, sizeof(offset));
+    memcpy(joint->site, site, sizeof(site));
+    joint->hasSite = hasSite;
+
+    valid = Get(p, end, &numJointChannels, sizeof(numJointChannels));
+    for(uint32_t c = 0; valid && c < numJointChannels; c++)
+    {
+      uint8_t type;
+      valid = Get(p, end, &type, sizeof(type)) && type <= Z_POSITION;
+      if(valid){ AddChannel(joint, (ChannelEnum)type); }
+    }
+  }
+
+  uint64_t textLength = 0;
+  valid = valid && Get(p, end, &textLength, sizeof(textLength)) &&
+          textLength <= (uint64_t)(end - p) &&
+          channels.size() == header.numChannel;
+  if(valid)
+  {
+    fileContents.assign(p, textLength);
+    p += textLength;
+
+    // then the padding up to the motion
+    while((p - file->data) % sizeof(double) != 0 && p < end && *p == '\0'){ p++; }
+  }
+
+  // the records have to end right where the motion starts,
+  // not just add up to the right size
+  valid = valid && p == file->data + header.motionOffset;
+  if(!valid)
+  {
+    delete file;
+    return false;
+  }
+
+  // the motion is used straight out of the mapping
+  numFrame = header.numFrame;
+  numChannel = header.numChannel;
+  interval = header.interval;
+  BuildSkeleton();
+  motion = (double *)(file->data + header.motionOffset);
+  motionFile = file;
+  return true;
+}
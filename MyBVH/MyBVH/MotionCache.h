@@ -0,0 +1,57 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	MotionCache.h
+//	------------------------
+//
+//	Layout of the binary .bvhb cache that sits next
+//	to a .bvh file so it can be reloaded instantly
+//
+///////////////////////////////////////////////////
+
+#ifndef _MOTION_CACHE_H_
+#define _MOTION_CACHE_H_
+
+#include <cstdint>
+#include <cstddef>
+
+// bump whenever the layout below changes
+#define MOTION_CACHE_VERSION 2
+
+// File layout:
+//   MotionCacheHeader
+//   for every joint
+//     int32  parent index (-1 for the root)
+//     double offset[3], site[3]
+//     uint8  hasSite
+//     uint32 name length, then the name
+//     uint32 channel count, then one uint8 ChannelEnum each
+//   uint64 hierarchy text length, then the text (fileContents)
+//   padding up to motionOffset
+//   double motion[numFrame * numChannel]
+struct MotionCacheHeader
+{
+  char     magic[4];       // "BVHB"
+  uint32_t version;        // MOTION_CACHE_VERSION
+  uint64_t checksum;       // of this header and the hierarchy, taken with checksum at 0
+  uint64_t motionChecksum; // of the motion array, only checked when asked to
+  uint64_t sourceSize;     // size of the .bvh this was made from
+  int64_t  sourceTime;     // and when it was last modified
+  uint32_t numJoints;
+  uint32_t numChannel;
+  uint32_t numFrame;
+  uint32_t padding;
+  double   interval;
+  uint64_t motionOffset;   // 8 byte aligned start of the motion array
+};
+
+// FNV style hash taken eight bytes at a time so it keeps up with the
+// disk. Pass the previous result as hash to carry on over a second
+// block, as long as the first block was a multiple of 8 bytes.
+#define CACHE_CHECKSUM_SEED 0xcbf29ce484222325ULL
+uint64_t CacheChecksum(const char * data, size_t size, uint64_t hash = CACHE_CHECKSUM_SEED);
+
+#endif
@@ -0,0 +1,145 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	MotionParser.cpp
+//	------------------------
+//
+//	Turns the text of the MOTION block into the
+//	motion array, one frame per line
+//
+///////////////////////////////////////////////////
+
+#include <vector>
+#include "MotionParser.h"
+#include "FastFloat.h"
+#include "Parallel.h"
+
+// below this many bytes one thread is quicker
+#define PARALLEL_MIN_BYTES (256 * 1024)
+
+// gaps between numbers on the same line
+static inline bool IsGap(char c)
+{
+  return c == ' ' || c == '\t' || c == ',' || c == '\r';
+}
+
+int ParseMotion(const char * begin, const char * end, double * motion, int numFrame, int numChannel)
+{
+  const char * p = begin;
+  return ParseMotionFrames(p, end, motion, numFrame, numChannel);
+}
+
+int ParseMotionFrames(const char *& p, const char * end, double * motion, int numFrame, int numChannel)
+{
+  int frame = 0;
+
+  while(frame < numFrame)
+  {
+    // skip blank lines to find the start of the next frame
+    while(p < end && (IsGap(*p) || *p == '\n')){ p++; }
+    if(p >= end){ break; }
+
+    double * out = motion + (long)frame * numChannel;
+    for(int c = 0; c < numChannel; c++)
+    {
+      while(p < end && IsGap(*p)){ p++; }
+
+      // line ended before every channel was read
+      if(p >= end || *p == '\n'){ return -1; }
+
+      // anything that isn't a number reads as 0 like atof
+      if(!ParseDouble(p, end, out[c])){ out[c] = 0.0; }
+
+      // skip whatever is left of this word
+      while(p < end && !IsGap(*p) && *p != '\n'){ p++; }
+    }
+
+    // ignore anything else on the line
+    const char * newline = (const char *)memchr(p, '\n', end - p);
+    p = newline ? newline : end;
+    frame++;
+  }
+  return frame;
+}
+
+// counts the lines in [begin, end) that have something on them
+static int CountFrameLines(const char * begin, const char * end)
+{
+  const char * p = begin;
+  int lines = 0;
+  while(p < end)
+  {
+    while(p < end && IsGap(*p)){ p++; }
+    if(p >= end){ break; }
+    if(*p != '\n'){ lines++; }
+
+    const char * newline = (const char *)memchr(p, '\n', end - p);
+    p = newline ? newline + 1 : end;
+  }
+  return lines;
+}
+
+int ParseMotionParallel(const char * begin, const char * end, double * motion, int numFrame, int numChannel)
+{
+  int numChunks = end - begin < PARALLEL_MIN_BYTES ? 1 : NumWorkers();
+  return ParseMotionParallel(begin, end, motion, numFrame, numChannel, numChunks);
+}
+
+int ParseMotionParallel(const char * begin, const char * end, double * motion, int numFrame, int numChannel, int numChunks)
+{
+  if(numChunks <= 1)
+  {
+    return ParseMotion(begin, end, motion, numFrame, numChannel);
+  }
+
+  // move each split point forward to the start of a line
+  // so no frame is ever cut in half
+  std::vector<const char *> splits(numChunks + 1);
+  splits[0] = begin;
+  splits[numChunks] = end;
+  for(int c = 1; c < numChunks; c++)
+  {
+    const char * p = begin + (end - begin) * c / numChunks;
+    if(p < splits[c - 1]){ p = splits[c - 1]; }
+    const char * newline = (const char *)memchr(p, '\n', end - p);
+    splits[c] = newline ? newline + 1 : end;
+  }
+
+  // first pass finds how many frames are in each chunk
+  // so every chunk knows which frame it starts at
+  std::vector<int> counts(numChunks);
+  ParallelFor(numChunks, numChunks, [&](int first, int last, int)
+  {
+    for(int c = first; c < last; c++){ counts[c] = CountFrameLines(splits[c], splits[c + 1]); }
+  });
+
+  // frames past the Frames: header are ignored, like the serial parser
+  std::vector<int> firstFrame(numChunks);
+  int total = 0;
+  for(int c = 0; c < numChunks; c++)
+  {
+    firstFrame[c] = total;
+    if(counts[c] > numFrame - total){ counts[c] = numFrame - total; }
+    total += counts[c];
+  }
+
+  // second pass parses every chunk straight into its place in motion
+  std::vector<int> parsed(numChunks);
+  ParallelFor(numChunks, numChunks, [&](int first, int last, int)
+  {
+    for(int c = first; c < last; c++)
+    {
+      parsed[c] = ParseMotion(splits[c], splits[c + 1], motion + (long)firstFrame[c] * numChannel, counts[c], numChannel);
+    }
+  });
+
+  // a short line anywhere fails the whole block
+  for(int c = 0; c < numChunks; c++)
+  {
+    if(parsed[c] != counts[c]){ return -1; }
+  }
+  return total;
+}
@@ -0,0 +1,36 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	MotionParser.h
+//	------------------------
+//
+//	Turns the text of the MOTION block into the
+//	motion array, one frame per line
+//
+///////////////////////////////////////////////////
+
+#ifndef _MOTION_PARSER_H_
+#define _MOTION_PARSER_H_
+
+// Reads up to numFrame lines of numChannel numbers from [begin, end)
+// into motion. Blank lines are skipped and extra numbers on a line are
+// ignored. Returns how many frames were read, or -1 if a line was short.
+int ParseMotion(const char * begin, const char * end, double * motion, int numFrame, int numChannel);
+
+// The same again, but p is left just after the last frame read
+// so a long block can be parsed a few frames at a time
+int ParseMotionFrames(const char *& p, const char * end, double * motion, int numFrame, int numChannel);
+
+// Same as ParseMotion, but splits the text on newlines into one chunk per
+// core and parses the chunks at the same time. Small blocks aren't worth
+// the threads and are parsed on the calling thread.
+int ParseMotionParallel(const char * begin, const char * end, double * motion, int numFrame, int numChannel);
+
+// The same with numChunks chunks on as many threads, however big the block,
+// so the chunking can be timed and checked on any machine
+int ParseMotionParallel(const char * begin, const char * end, double * motion, int numFrame, int numChannel, int numChunks);
+
+#endif
@@ -0,0 +1,66 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	Parallel.h
+//	------------------------
+//
+//	Splits a range of work over the cores
+//
+///////////////////////////////////////////////////
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <thread>
+#include <vector>
+#include <atomic>
+
+// how many threads are worth starting on this machine
+inline int NumWorkers()
+{
+  int n = (int)std::thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+// Calls work(first, last, worker) on numWorkers threads so that together
+// they cover [0, count). The calling thread takes the first slice itself
+// and returns once every slice has finished.
+template <typename Work>
+void ParallelFor(int count, int numWorkers, Work work)
+{
+  if(numWorkers > count){ numWorkers = count; }
+  if(numWorkers <= 1)
+  {
+    if(count > 0){ work(0, count, 0); }
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  for(int w = 1; w < numWorkers; w++)
+  {
+    int first = (int)((long)count * w / numWorkers);
+    int last  = (int)((long)count * (w + 1) / numWorkers);
+    threads.push_back(std::thread(work, first, last, w));
+  }
+  work(0, (int)((long)count / numWorkers), 0);
+
+  for(size_t t = 0; t < threads.size(); t++){ threads[t].join(); }
+}
+
+// Calls work(item, worker) for every item in [0, count), handing the
+// items out one at a time as workers come free. Better than
+// ParallelFor when items cost very different amounts, like files.
+template <typename Work>
+void ParallelForEach(int count, int numWorkers, Work work)
+{
+  std::atomic<int> next(0);
+  ParallelFor(numWorkers, numWorkers, [&](int, int, int worker)
+  {
+    for(int item = next++; item < count; item = next++){ work(item, worker); }
+  });
+}
+
+#endif
@@ -0,0 +1,228 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	Pose.cpp
+//	------------------------
+//
+//	Joint rotations as quaternions, for blending
+//	between keyframes without Euler angle wraps
+//
+///////////////////////////////////////////////////
+
+#include <cmath>
+#include <vector>
+#include "Pose.h"
+
+// closer than this to +-90 degrees on the middle axis and
+// the first and last axes turn about the same line
+#define GIMBAL_LIMIT  (1. - 1e-9)
+
+// below this the two keys are the same rotation
+#define SLERP_MIN_SINE  1e-6
+
+void FrameRotations(const Skeleton & skeleton, const double * frame, glm::dquat * rotations)
+{
+  static const glm::dvec3 axes[3] =
+  {
+    glm::dvec3(1., 0., 0.), glm::dvec3(0., 1., 0.), glm::dvec3(0., 0., 1.)
+  };
+
+  for(int j = 0; j < skeleton.numJoints; j++)
+  {
+    // same order forward kinematics applies them in
+    glm::dquat q = glm::dquat(1., 0., 0., 0.);
+    for(int r = 0; r < skeleton.rotationCount[j]; r++)
+    {
+      double angle = glm::radians(frame[skeleton.rotationChannel[3 * j + r]]);
+      q = q * glm::angleAxis(angle, axes[skeleton.rotationAxis[3 * j + r]]);
+    }
+    rotations[j] = q;
+  }
+}
+
+// angle plus however many turns brings it closest to reference
+static double Unwrap(double angle, double reference)
+{
+  return angle + 360. * floor((reference - angle) / 360. + 0.5);
+}
+
+void QuatToEuler(const glm::dquat & q, const unsigned char * axes, const double * reference, double * angles)
+{
+  int i = axes[0], j = axes[1], k = axes[2];
+
+  // XYZ, YZX and ZXY go one way round, the other three flip signs
+  double sign = (j - i + 3) % 3 == 1 ? 1. : -1.;
+
+  // R(row, column) of Ri(a) * Rj(b) * Rk(c)
+  glm::dmat3 m = glm::mat3_cast(q);
+#define R(row, column) m[column][row]
+
+  double sinB = glm::clamp(sign * R(i, k), -1., 1.);
+  double a, b = asin(sinB), c;
+
+  if(fabs(sinB) < GIMBAL_LIMIT)
+  {
+    a = atan2(-sign * R(j, k), R(k, k));
+    c = atan2(-sign * R(i, j), R(i, i));
+  }
+  else
+  {
+    // only a + c or a - c is known, keep c where it was and
+    // find a from what is left once b and c are taken back off
+    c = glm::radians(reference[2]);
+    glm::dvec3 axisJ = glm::dvec3(0.), axisK = glm::dvec3(0.);
+    axisJ[j] = 1.;
+    axisK[k] = 1.;
+    m = m * glm::mat3_cast(glm::angleAxis(-c, axisK) * glm::angleAxis(-b, axisJ));
+
+    int n1 = (i + 1) % 3, n2 = (i + 2) % 3;
+    a = atan2(R(n2, n1), R(n1, n1));
+  }
+#undef R
+
+  // (a + 180, 180 - b, c + 180) is the same rotation, use
+  // whichever of the two is nearer the reference angles
+  double first[3] = { glm::degrees(a), glm::degrees(b), glm::degrees(c) };
+  double second[3] = { first[0] + 180., 180. - first[1], first[2] + 180. };
+  double firstDistance = 0., secondDistance = 0.;
+  for(int r = 0; r < 3; r++)
+  {
+    first[r] = Unwrap(first[r], reference[r]);
+    second[r] = Unwrap(second[r], reference[r]);
+    firstDistance += fabs(first[r] - reference[r]);
+    secondDistance += fabs(second[r] - reference[r]);
+  }
+
+  const double * best = firstDistance <= secondDistance ? first : second;
+  for(int r = 0; r < 3; r++){ angles[r] = best[r]; }
+}
+
+void InterpolateFrames(const Skeleton & skeleton, const double * startKey, const double * endKey,
+                       int span, double * frames, int mode, InterpolationWorkspace & work)
+{
+  int numChannel = skeleton.numChannel;
+  if(span < 2){ return; }
+
+  // joints with a named order are blended as quaternions,
+  // every other channel is a plain lerp
+  std::vector<int> & blended = work.blended;
+  std::vector<unsigned char> & isBlended = work.isBlended;
+  blended.clear();
+  isBlended.assign(numChannel, 0);
+  for(int j = 0; j < skeleton.numJoints; j++)
+  {
+    if(skeleton.rotationOrder[j] > ROTATION_ZYX){ continue; }
+    blended.push_back(j);
+    for(int r = 0; r < 3; r++){ isBlended[skeleton.rotationChannel[3 * j + r]] = 1; }
+  }
+  std::vector<int> & lerped = work.lerped;
+  lerped.clear();
+  for(int c = 0; c < numChannel; c++)
+  {
+    if(!isBlended[c]){ lerped.push_back(c); }
+  }
+
+  work.startRotations.resize(skeleton.numJoints);
+  work.endRotations.resize(skeleton.numJoints);
+  FrameRotations(skeleton, startKey, work.startRotations.data());
+  FrameRotations(skeleton, endKey, work.endRotations.data());
+
+  // The keys and the blend as one array per component, so the
+  // blend over every joint is a straight loop of multiply-adds
+  int count = blended.size();
+  work.keys.resize(8 * count);
+  work.angle.resize(count);
+  work.inverseSine.resize(count);
+  work.weights.resize(2 * count);
+  work.blend.resize(4 * count);
+  double * keys = work.keys.data(), * blend = work.blend.data();
+  double * w0 = keys + 0 * count, * x0 = keys + 1 * count, * y0 = keys + 2 * count, * z0 = keys + 3 * count;
+  double * w1 = keys + 4 * count, * x1 = keys + 5 * count, * y1 = keys + 6 * count, * z1 = keys + 7 * count;
+  double * angle = work.angle.data(), * inverseSine = work.inverseSine.data();
+  double * startWeight = work.weights.data(), * endWeight = startWeight + count;
+  double * w = blend + 0 * count, * x = blend + 1 * count, * y = blend + 2 * count, * z = blend + 3 * count;
+
+  for(int b = 0; b < count; b++)
+  {
+    glm::dquat q0 = work.startRotations[blended[b]];
+    glm::dquat q1 = work.endRotations[blended[b]];
+
+    // q and -q are the same rotation, take the short way round
+    double cosine = glm::dot(q0, q1);
+    if(cosine < 0.)
+    {
+      q1 = -q1;
+      cosine = -cosine;
+    }
+
+    w0[b] = q0.w; x0[b] = q0.x; y0[b] = q0.y; z0[b] = q0.z;
+    w1[b] = q1.w; x1[b] = q1.x; y1[b] = q1.y; z1[b] = q1.z;
+
+    angle[b] = acos(glm::min(cosine, 1.));
+    double sine = sin(angle[b]);
+    inverseSine[b] = sine > SLERP_MIN_SINE ? 1. / sine : 0.;
+  }
+
+  for(int f = 1; f < span; f++)
+  {
+    double t = (double)f / span;
+    double * frame = frames + (long)(f - 1) * numChannel;
+    const double * previous = f == 1 ? startKey : frame - numChannel;
+
+    // weights of the two keys for every joint
+    for(int b = 0; b < count; b++)
+    {
+      if(mode == INTERPOLATE_SLERP && inverseSine[b] > 0.)
+      {
+        startWeight[b] = sin((1. - t) * angle[b]) * inverseSine[b];
+        endWeight[b] = sin(t * angle[b]) * inverseSine[b];
+      }
+      else
+      {
+        startWeight[b] = 1. - t;
+        endWeight[b] = t;
+      }
+    }
+
+    for(int b = 0; b < count; b++)
+    {
+      w[b] = startWeight[b] * w0[b] + endWeight[b] * w1[b];
+      x[b] = startWeight[b] * x0[b] + endWeight[b] * x1[b];
+      y[b] = startWeight[b] * y0[b] + endWeight[b] * y1[b];
+      z[b] = startWeight[b] * z0[b] + endWeight[b] * z1[b];
+    }
+
+    // slerp stays unit length, nlerp has to be brought back
+    if(mode == INTERPOLATE_NLERP)
+    {
+      for(int b = 0; b < count; b++)
+      {
+        double scale = 1. / sqrt(w[b] * w[b] + x[b] * x[b] + y[b] * y[b] + z[b] * z[b]);
+        w[b] *= scale;
+        x[b] *= scale;
+        y[b] *= scale;
+        z[b] *= scale;
+      }
+    }
+
+    // back to Euler angles, kept close to the frame before
+    for(int b = 0; b < count; b++)
+    {
+      int j = blended[b];
+      const int * rotation = &skeleton.rotationChannel[3 * j];
+      double reference[3] = { previous[rotation[0]], previous[rotation[1]], previous[rotation[2]] };
+      double angles[3];
+      QuatToEuler(glm::dquat(w[b], x[b], y[b], z[b]), &skeleton.rotationAxis[3 * j], reference, angles);
+      for(int r = 0; r < 3; r++){ frame[rotation[r]] = angles[r]; }
+    }
+
+    for(size_t l = 0; l < lerped.size(); l++)
+    {
+      int c = lerped[l];
+      frame[c] = (1. - t) * startKey[c] + t * endKey[c];
+    }
+  }
+}
@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	Pose.h
+//	------------------------
+//
+//	Joint rotations as quaternions, for blending
+//	between keyframes without Euler angle wraps
+//
+///////////////////////////////////////////////////
+
+#ifndef _POSE_H_
+#define _POSE_H_
+
+#include <vector>
+#include "Skeleton.h"
+#include "gtc/quaternion.hpp"
+
+// How LerpKeyframes fills in the frames between two keys
+enum KeyInterpolation
+{
+  INTERPOLATE_EULER,    // every channel on its own, the way it always was
+  INTERPOLATE_SLERP,    // constant speed along the shortest way round
+  INTERPOLATE_NLERP,    // normalised lerp, cheaper and close to slerp for small turns
+  INTERPOLATE_SPLINE    // each channel follows its curve through every key, see KeyframeSplines.h
+};
+
+// Every joint's rotation in one frame, the identity for joints
+// without rotation channels. rotations holds numJoints.
+void FrameRotations(const Skeleton & skeleton, const double * frame, glm::dquat * rotations);
+
+// Degrees for three rotation channels turning about axes (0 x, 1 y,
+// 2 z) in that order. Of all the angles giving q, the ones nearest
+// reference are used, so channels don't jump by 360 or flip to the
+// other Euler solution from one frame to the next.
+void QuatToEuler(const glm::dquat & q, const unsigned char * axes, const double * reference, double * angles);
+
+// Everything InterpolateFrames works on, kept between calls so once
+// its sizes settle lerping a span doesn't allocate. Threads lerping
+// spans at once each need their own.
+struct InterpolationWorkspace
+{
+  std::vector<int> blended;                 // joints blended as quaternions
+  std::vector<unsigned char> isBlended;     // numChannel, whether each is in one of them
+  std::vector<int> lerped;                  // and the channels that aren't
+  std::vector<glm::dquat> startRotations;   // every joint in the two keys
+  std::vector<glm::dquat> endRotations;
+  std::vector<double> keys;                 // the blended joints' keys, one array per component
+  std::vector<double> angle;                // between each joint's two keys
+  std::vector<double> inverseSine;
+  std::vector<double> weights;              // of the two keys on the frame being filled
+  std::vector<double> blend;                // and the rotations they give, one array per component
+};
+
+// Fills the span - 1 frames between two keys span frames apart,
+// frames pointing at the first of them. Joints with one of the six
+// rotation orders are blended as quaternions, everything else, the
+// root position included, is lerped channel by channel.
+void InterpolateFrames(const Skeleton & skeleton, const double * startKey, const double * endKey,
+                       int span, double * frames, int mode, InterpolationWorkspace & work);
+
+#endif
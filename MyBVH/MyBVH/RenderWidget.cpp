@@ -32,6 +32,16 @@ RenderWidget::RenderWidget(char *filename, MasterWidget *parent)
 		if(strlen(filename) == 0){bvh = new BVH(); }
 		else {bvh = new BVH(filename); }
 		bvh->FindMinMax();
+		loadingFrames = bvh->IsLoading();
+		savePrecision = -1;
+		compressMotion = false;
+		useMotionCache = false;
+		interpolation = INTERPOLATE_EULER;
+		liveLerp = false;
+		ikSolver = IK_JACOBIAN;
+		ikMaxIterations = bvh->ikMaxIterations;
+		ikTolerance = bvh->ikTolerance;
+		ikTimeBudget = bvh->ikTimeBudget;
 		std::cout << "Reading: ";
 		std::cout << filename << '\n';
 
@@ -182,20 +192,15 @@ void RenderWidget::paintGL()
 	}
 	glMultMatrixf(view);
 
-	// translate based on animation
-	Cartesian3 min = bvh->minCoords;
-	Cartesian3 max = bvh->maxCoords;
-	float xTrans = (max.x + min.x) / 2.;
-	float yTrans = (max.y + min.y) / 2.;
-	float zTrans = min.z;
-
-	//std::cout << xTrans << " " << yTrans << " " << zTrans << '\n';
-	glTranslatef(-xTrans, -yTrans, zTrans - 25.);
+	// translate based on animation, the same offset
+	// the BVH adds to the control points
+	glm::vec3 sceneOffset = bvh->SceneOffset();
+	glTranslatef(sceneOffset.x, sceneOffset.y, sceneOffset.z);
 
 	// Render Skeleton At Current Frame
-	bvh->RenderFigure(cFrame, 1.0, &camera);
+	bvh->RenderFigure(cFrame, 1.0);
 
-	glTranslatef(xTrans, yTrans, -(zTrans - 25.));
+	glTranslatef(-sceneOffset.x, -sceneOffset.y, -sceneOffset.z);
 
 	// render the control points
 	bvh->RenderControlPoints();
@@ -285,6 +290,13 @@ void RenderWidget::mouseMoveEvent(QMouseEvent *event)
 
 		bvh->MoveJoint(mouseMove);
 
+		// only the spans either side of the key are redone
+		if(liveLerp && bvh->keyframes.Contains(bvh->cFrame))
+		{
+			bvh->interpolation = interpolation;
+			bvh->LerpKeyframes();
+		}
+
 		// if(doneOnce != true)
 		// {
 		//
@@ -366,8 +378,22 @@ void RenderWidget::loadButtonPressed()
 		cTime = 0.;
 		cFrame = 0;
 
-		bvh = new BVH(newFileName.toStdString().c_str());
+		// stops the old file streaming in the background
+		delete bvh;
+		delete mousePicker;
+
+		bvh = new BVH();
+		bvh->useMotionCache = useMotionCache;
+		bvh->Load(newFileName.toStdString().c_str());
 		bvh->FindMinMax();
+		bvh->SetIKSolver(ikSolver);
+		bvh->ikMaxIterations = ikMaxIterations;
+		bvh->ikTolerance = ikTolerance;
+		bvh->ikTimeBudget = ikTimeBudget;
+		loadingFrames = bvh->IsLoading();
+
+		// streamed files are compressed once they finish
+		if(compressMotion && !loadingFrames){ compressLoadedMotion(); }
 
 		// initialise the mouse clicker
 		mousePicker = new MousePick(&(bvh->globalPositions), 1.0);
@@ -379,6 +405,16 @@ void RenderWidget::loadButtonPressed()
 	}
 }
 
+void RenderWidget::compressLoadedMotion()
+{
+	size_t denseBytes = bvh->MotionBytes();
+	if(bvh->Compress())
+	{
+		std::cout << "Compressed motion from " << denseBytes / 1024 << " KB to "
+		          << bvh->MotionBytes() / 1024 << " KB" << '\n';
+	}
+}
+
 void RenderWidget::saveButtonPressed()
 {
 	// if we need to start playing the animation again
@@ -395,7 +431,8 @@ void RenderWidget::saveButtonPressed()
 
 	if(fileName.toStdString().length() > 0)
 	{
-		bvh->SaveFile(fileName.toStdString());
+		bvh->savePrecision = savePrecision;
+		if(bvh->SaveFile(fileName.toStdString())){ std::cout << "Saved File" << '\n'; }
 	}
 
 	if(reset)
@@ -432,6 +469,16 @@ void RenderWidget::timerUpdate()
 		updateNeeded = true;
 	}
 
+	// Once streaming finishes, the bounding box can use every frame
+	if(loadingFrames && bvh->IsLoading() == false)
+	{
+		bvh->WaitForLoad();
+		bvh->FindMinMax();
+		if(compressMotion){ compressLoadedMotion(); }
+		loadingFrames = false;
+		updateNeeded = true;
+	}
+
 	// Control Playback
 	if(paused == false)
 	{
@@ -439,6 +486,11 @@ void RenderWidget::timerUpdate()
 		cTime += delta * playbackSpeed;
 		int frame = (int)((cTime / (bvh->interval * 1000))) % (int)(bvh->numFrame);
 
+		// can't play past what has been read in so far
+		int loaded = bvh->FramesLoaded();
+		if(frame >= loaded){ frame = loaded - 1; }
+		if(frame < 0){ frame = 0; }
+
 		// Only Update If We need To
 		if(frame != cFrame)
 		{
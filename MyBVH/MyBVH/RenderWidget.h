@@ -55,6 +55,30 @@ class RenderWidget : public QGLWidget
 	float startTime;
 	int cFrame;
 	bool paused;
+
+	// frames are still streaming in from the file
+	bool loadingFrames;
+
+	// decimal places to save with, -1 for exact
+	int savePrecision;
+
+	// keep loaded clips as 16 bit samples
+	bool compressMotion;
+
+	// read and write .bvhb caches next to the files loaded
+	bool useMotionCache;
+
+	// how keyframes are lerped, and whether that happens
+	// while a keyframe is being dragged rather than on request
+	int interpolation;
+	bool liveLerp;
+
+	// IKSolverType used to drag joints and when it stops
+	// iterating, kept for every file loaded
+	int ikSolver;
+	int ikMaxIterations;
+	double ikTolerance;
+	int ikTimeBudget;
 	float playbackSpeed;
 
 	// camera options
@@ -99,6 +123,9 @@ class RenderWidget : public QGLWidget
 	// allowing the camera to zoom in
 	void updatePerspective();
 
+	// keeps the clip as 16 bit samples and says how much that saved
+	void compressLoadedMotion();
+
 	protected:
 	// called when OpenGL context is set up
 	void initializeGL();
@@ -0,0 +1,233 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	Skeleton.cpp
+//	------------------------
+//
+//	The joint tree flattened into plain arrays so
+//	forward kinematics is one loop over the joints
+//
+///////////////////////////////////////////////////
+
+#include <cmath>
+#include "Skeleton.h"
+#include "gtc/matrix_transform.hpp"
+
+// SSE is always there on x86-64, anything else multiplies with glm
+#if defined(__SSE__) || defined(_M_X64)
+#define SKELETON_SSE
+#include <xmmintrin.h>
+#endif
+
+// which axis each of the three channels turns about, per RotationOrder
+static const int orderAxes[6][3] =
+{
+  {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}
+};
+
+// Rotation for one of the six orders straight from the sines and
+// cosines of the x, y and z angles, rather than three glm::rotate
+// calls each building a matrix for an arbitrary axis. R[row][column]
+// is Ra * Rb * Rc for order abc, stored into m's columns. ORDER is
+// known at compile time so each evaluator only gets its own case.
+template <int ORDER>
+static inline void EulerMatrix(const float * c, const float * s, glm::mat4 & m)
+{
+  float cx = c[0], cy = c[1], cz = c[2];
+  float sx = s[0], sy = s[1], sz = s[2];
+  float R[3][3];
+
+  switch(ORDER)
+  {
+    case(ROTATION_XYZ):
+      R[0][0] = cy * cz;                 R[0][1] = -cy * sz;                R[0][2] = sy;
+      R[1][0] = cx * sz + sx * sy * cz;  R[1][1] = cx * cz - sx * sy * sz;  R[1][2] = -sx * cy;
+      R[2][0] = sx * sz - cx * sy * cz;  R[2][1] = sx * cz + cx * sy * sz;  R[2][2] = cx * cy;
+      break;
+    case(ROTATION_XZY):
+      R[0][0] = cz * cy;                 R[0][1] = -sz;                     R[0][2] = cz * sy;
+      R[1][0] = cx * sz * cy + sx * sy;  R[1][1] = cx * cz;                 R[1][2] = cx * sz * sy - sx * cy;
+      R[2][0] = sx * sz * cy - cx * sy;  R[2][1] = sx * cz;                 R[2][2] = sx * sz * sy + cx * cy;
+      break;
+    case(ROTATION_YXZ):
+      R[0][0] = cy * cz + sy * sx * sz;  R[0][1] = sy * sx * cz - cy * sz;  R[0][2] = sy * cx;
+      R[1][0] = cx * sz;                 R[1][1] = cx * cz;                 R[1][2] = -sx;
+      R[2][0] = cy * sx * sz - sy * cz;  R[2][1] = sy * sz + cy * sx * cz;  R[2][2] = cy * cx;
+      break;
+    case(ROTATION_YZX):
+      R[0][0] = cy * cz;                 R[0][1] = sy * sx - cy * sz * cx;  R[0][2] = cy * sz * sx + sy * cx;
+      R[1][0] = sz;                      R[1][1] = cz * cx;                 R[1][2] = -cz * sx;
+      R[2][0] = -sy * cz;                R[2][1] = sy * sz * cx + cy * sx;  R[2][2] = cy * cx - sy * sz * sx;
+      break;
+    case(ROTATION_ZXY):
+      R[0][0] = cz * cy - sz * sx * sy;  R[0][1] = -sz * cx;                R[0][2] = cz * sy + sz * sx * cy;
+      R[1][0] = sz * cy + cz * sx * sy;  R[1][1] = cz * cx;                 R[1][2] = sz * sy - cz * sx * cy;
+      R[2][0] = -cx * sy;                R[2][1] = sx;                      R[2][2] = cx * cy;
+      break;
+    default:    // ROTATION_ZYX
+      R[0][0] = cz * cy;                 R[0][1] = cz * sy * sx - sz * cx;  R[0][2] = cz * sy * cx + sz * sx;
+      R[1][0] = sz * cy;                 R[1][1] = sz * sy * sx + cz * cx;  R[1][2] = sz * sy * cx - cz * sx;
+      R[2][0] = -sy;                     R[2][1] = cy * sx;                 R[2][2] = cy * cx;
+      break;
+  }
+
+  for(int col = 0; col < 3; col++)
+  {
+    m[col][0] = R[0][col];
+    m[col][1] = R[1][col];
+    m[col][2] = R[2][col];
+    m[col][3] = 0.f;
+  }
+}
+
+// Local matrix for a joint with three rotation channels in ORDER, and
+// Xposition Yposition Zposition if POSITION. Nothing is looked up
+// or branched on per channel, the layout is all in the template.
+template <int ORDER, bool POSITION>
+static void EvaluateJoint(const Skeleton & skeleton, int j, const double * frame, glm::mat4 & m)
+{
+  const int * rotation = &skeleton.rotationChannel[3 * j];
+  float c[3], s[3];
+  for(int r = 0; r < 3; r++)
+  {
+    float angle = (float)glm::radians(frame[rotation[r]]);
+    c[orderAxes[ORDER][r]] = std::cos(angle);
+    s[orderAxes[ORDER][r]] = std::sin(angle);
+  }
+  EulerMatrix<ORDER>(c, s, m);
+
+  if(POSITION)
+  {
+    const int * position = &skeleton.positionChannel[3 * j];
+    m[3] = glm::vec4(frame[position[0]], frame[position[1]], frame[position[2]], 1.);
+  }
+  else
+  {
+    m[3] = glm::vec4(skeleton.offset[j], 1.);
+  }
+}
+
+// Joints with no rotations, or odd channel lists that never turn
+// up in practice, go the long way with glm::translate and glm::rotate
+static void EvaluateAnyJoint(const Skeleton & skeleton, int j, const double * frame, glm::mat4 & m)
+{
+  static const glm::vec3 axes[3] =
+  {
+    glm::vec3(1., 0., 0.), glm::vec3(0., 1., 0.), glm::vec3(0., 0., 1.)
+  };
+
+  glm::vec3 translation = skeleton.offset[j];
+  if(skeleton.usesPosition[j])
+  {
+    const int * position = &skeleton.positionChannel[3 * j];
+    for(int a = 0; a < 3; a++)
+    {
+      if(position[a] >= 0){ translation[a] = frame[position[a]]; }
+    }
+  }
+  m = glm::translate(glm::mat4(1.), translation);
+
+  for(int r = 0; r < skeleton.rotationCount[j]; r++)
+  {
+    double angle = frame[skeleton.rotationChannel[3 * j + r]];
+    m = glm::rotate(m, (float)glm::radians(angle), axes[skeleton.rotationAxis[3 * j + r]]);
+  }
+}
+
+// [has all three position channels][RotationOrder]
+static const Skeleton::JointEvaluator evaluators[2][6] =
+{
+  {
+    EvaluateJoint<ROTATION_XYZ, false>, EvaluateJoint<ROTATION_XZY, false>,
+    EvaluateJoint<ROTATION_YXZ, false>, EvaluateJoint<ROTATION_YZX, false>,
+    EvaluateJoint<ROTATION_ZXY, false>, EvaluateJoint<ROTATION_ZYX, false>
+  },
+  {
+    EvaluateJoint<ROTATION_XYZ, true>, EvaluateJoint<ROTATION_XZY, true>,
+    EvaluateJoint<ROTATION_YXZ, true>, EvaluateJoint<ROTATION_YZX, true>,
+    EvaluateJoint<ROTATION_ZXY, true>, EvaluateJoint<ROTATION_ZYX, true>
+  }
+};
+
+// out = a * b for matrices whose bottom row is 0 0 0 1, which every
+// joint's is. Same sums as glm's operator*, less the terms that are
+// always zero, four floats at a time.
+static inline void MultiplyAffine(const glm::mat4 & a, const glm::mat4 & b, glm::mat4 & out)
+{
+#ifdef SKELETON_SSE
+  __m128 a0 = _mm_loadu_ps(&a[0][0]);
+  __m128 a1 = _mm_loadu_ps(&a[1][0]);
+  __m128 a2 = _mm_loadu_ps(&a[2][0]);
+  __m128 a3 = _mm_loadu_ps(&a[3][0]);
+
+  for(int col = 0; col < 4; col++)
+  {
+    __m128 sum = _mm_mul_ps(a0, _mm_set1_ps(b[col][0]));
+    sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(b[col][1])));
+    sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(b[col][2])));
+    if(col == 3){ sum = _mm_add_ps(sum, a3); }
+    _mm_storeu_ps(&out[col][0], sum);
+  }
+#else
+  out = a * b;
+#endif
+}
+
+Skeleton::Skeleton()
+{
+  numJoints = 0;
+  numChannel = 0;
+}
+
+void Skeleton::Resize(int numJoints, int numChannel)
+{
+  this->numJoints = numJoints;
+  this->numChannel = numChannel;
+
+  parent.assign(numJoints, -1);
+  offset.assign(numJoints, glm::vec3(0.));
+  channelStart.assign(numJoints, 0);
+  channelCount.assign(numJoints, 0);
+  channelType.assign(numChannel, 0);
+  usesPosition.assign(numJoints, 0);
+  positionChannel.assign(3 * numJoints, -1);
+  rotationCount.assign(numJoints, 0);
+  rotationChannel.assign(3 * numJoints, -1);
+  rotationAxis.assign(3 * numJoints, 0);
+  rotationOrder.assign(numJoints, ROTATION_NONE);
+  evaluator.assign(numJoints, EvaluateAnyJoint);
+}
+
+void Skeleton::ChooseEvaluators()
+{
+  for(int j = 0; j < numJoints; j++)
+  {
+    const int * position = &positionChannel[3 * j];
+    bool hasPosition = position[0] >= 0 && position[1] >= 0 && position[2] >= 0;
+
+    // a joint with only some of the position channels
+    // mixes them with its offset, leave that to the long way
+    if(rotationOrder[j] > ROTATION_ZYX || (usesPosition[j] && !hasPosition))
+    {
+      evaluator[j] = EvaluateAnyJoint;
+    }
+    else
+    {
+      evaluator[j] = evaluators[usesPosition[j] ? 1 : 0][rotationOrder[j]];
+    }
+  }
+}
+
+void Skeleton::ForwardKinematics(const double * frame, glm::mat4 * local, glm::mat4 * global) const
+{
+  for(int j = 0; j < numJoints; j++)
+  {
+    evaluator[j](*this, j, frame, local[j]);
+
+    if(parent[j] < 0){ global[j] = local[j]; }
+    else             { MultiplyAffine(global[parent[j]], local[j], global[j]); }
+  }
+}
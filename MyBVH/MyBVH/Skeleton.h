@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	Skeleton.h
+//	------------------------
+//
+//	The joint tree flattened into plain arrays so
+//	forward kinematics is one loop over the joints
+//
+///////////////////////////////////////////////////
+
+#ifndef _SKELETON_H_
+#define _SKELETON_H_
+
+#include <vector>
+#include "glm.hpp"
+
+// The order a joint's rotation channels are listed in, which is
+// the order they are applied, ROTATION_XYZ meaning X then Y then Z
+enum RotationOrder
+{
+  ROTATION_XYZ, ROTATION_XZY, ROTATION_YXZ,
+  ROTATION_YZX, ROTATION_ZXY, ROTATION_ZYX,
+  ROTATION_NONE,    // no rotation channels at all
+  ROTATION_OTHER    // one or two axes, or an axis twice
+};
+
+// Joints are numbered the same as BVH::joints, which always lists a
+// parent before its children, so every array here is walked front to
+// back. Per joint arrays with three entries per joint hold them
+// together, joint j at [3 * j], [3 * j + 1] and [3 * j + 2].
+struct Skeleton
+{
+  Skeleton();
+
+  int numJoints;
+  int numChannel;
+
+  // -1 for a root, otherwise lower than the joint's own index
+  std::vector<int> parent;
+
+  // where each joint sits relative to its parent
+  std::vector<glm::vec3> offset;
+
+  // which of a frame's values belong to each joint
+  std::vector<int> channelStart;
+  std::vector<int> channelCount;
+
+  // ChannelEnum of every value in a frame
+  std::vector<unsigned char> channelType;
+
+  // 1 for joints whose position channels move them (the root),
+  // everyone else stays at their offset
+  std::vector<unsigned char> usesPosition;
+
+  // 3 per joint, the Xposition, Yposition and Zposition
+  // value in the frame or -1 if the joint doesn't have it
+  std::vector<int> positionChannel;
+
+  // 3 per joint in the order they are applied, with rotationAxis
+  // saying which is which (0 x, 1 y, 2 z)
+  std::vector<int> rotationCount;
+  std::vector<int> rotationChannel;
+  std::vector<unsigned char> rotationAxis;
+  std::vector<unsigned char> rotationOrder;
+
+  // Builds one joint's local matrix from a frame. Each joint gets the
+  // one made for its rotation order and position channels.
+  typedef void (*JointEvaluator)(const Skeleton & skeleton, int joint, const double * frame, glm::mat4 & local);
+  std::vector<JointEvaluator> evaluator;
+
+  // sets up numJoints joints with nothing in them
+  void Resize(int numJoints, int numChannel);
+
+  // picks every joint's evaluator once the arrays above are filled in
+  void ChooseEvaluators();
+
+  // Local and global matrices for every joint from one frame, global
+  // being the parent's global times the local. Both arrays hold numJoints.
+  void ForwardKinematics(const double * frame, glm::mat4 * local, glm::mat4 * global) const;
+};
+
+#endif
@@ -3,10 +3,11 @@
 ######################################################################
 
 QT+=opengl
+CONFIG+=thread
 LIBS+=-lGLU
 TEMPLATE = app
 TARGET = myBVH
-INCLUDEPATH += . ../glm
+INCLUDEPATH += . ../glm ../eigen-3.3.8
 
 # The following define makes your compiler warn you if you use any
 # feature of Qt which has been marked as deprecated (the exact warnings
@@ -25,6 +26,17 @@ HEADERS += Cartesian3.h \
            MasterWidget.h \
            MousePick.h \
            BVH.h \
+           MappedFile.h \
+           FastFloat.h \
+           MotionParser.h \
+           Parallel.h \
+           MotionCache.h \
+           CompressedMotion.h \
+           Skeleton.h \
+           Pose.h \
+           KeyframeTrack.h \
+           KeyframeSplines.h \
+           IKSolver.h \
            matrix.h
 
 SOURCES += Cartesian3.cpp \
@@ -32,4 +44,15 @@ SOURCES += Cartesian3.cpp \
            MasterWidget.cpp \
            MousePick.cpp \
            BVH.cpp \
+           BVHWriter.cpp \
+           BVHRender.cpp \
+           MappedFile.cpp \
+           MotionParser.cpp \
+           MotionCache.cpp \
+           CompressedMotion.cpp \
+           Skeleton.cpp \
+           Pose.cpp \
+           KeyframeTrack.cpp \
+           KeyframeSplines.cpp \
+           IKSolver.cpp \
            main.cpp
@@ -0,0 +1,41 @@
+######################################################################
+# bvhtool, the BVH loading and editing code without Qt or GL so
+# folders of clips can be processed on machines with no display
+######################################################################
+
+CONFIG -= qt app_bundle
+CONFIG += console thread
+TEMPLATE = app
+TARGET = bvhtool
+INCLUDEPATH += . ../MyBVH ../glm ../eigen-3.3.8
+
+# Input
+HEADERS += ../MyBVH/Cartesian3.h \
+           ../MyBVH/BVH.h \
+           ../MyBVH/MappedFile.h \
+           ../MyBVH/FastFloat.h \
+           ../MyBVH/MotionParser.h \
+           ../MyBVH/Parallel.h \
+           ../MyBVH/MotionCache.h \
+           ../MyBVH/CompressedMotion.h \
+           ../MyBVH/Skeleton.h \
+           ../MyBVH/Pose.h \
+           ../MyBVH/KeyframeTrack.h \
+           ../MyBVH/KeyframeSplines.h \
+           ../MyBVH/IKSolver.h \
+           ../MyBVH/Benchmark.h
+
+SOURCES += ../MyBVH/Cartesian3.cpp \
+           ../MyBVH/BVH.cpp \
+           ../MyBVH/BVHWriter.cpp \
+           ../MyBVH/MappedFile.cpp \
+           ../MyBVH/MotionParser.cpp \
+           ../MyBVH/MotionCache.cpp \
+           ../MyBVH/CompressedMotion.cpp \
+           ../MyBVH/Skeleton.cpp \
+           ../MyBVH/Pose.cpp \
+           ../MyBVH/KeyframeTrack.cpp \
+           ../MyBVH/KeyframeSplines.cpp \
+           ../MyBVH/IKSolver.cpp \
+           ../MyBVH/Benchmark.cpp \
+           main.cpp
@@ -0,0 +1,399 @@
+///////////////////////////////////////////////////
+//
+//	Jonathan Alderson
+//	November, 2020
+//
+//	------------------------
+//	main.cpp
+//	------------------------
+//
+//	bvhtool, runs the BVH class over whole folders
+//	of clips without Qt, GL or a display
+//
+///////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "BVH.h"
+#include "Parallel.h"
+#include "Benchmark.h"
+
+// A locked joint is planted while it is within LOCK_HEIGHT of the lowest
+// it gets and moving slower than LOCK_SPEED a second, both as fractions
+// of its reach from the root. It then takes LOCK_BLEND seconds to go
+// from where it was held back onto its own path.
+#define LOCK_HEIGHT  0.05
+#define LOCK_SPEED   0.25
+#define LOCK_BLEND   0.1
+
+// everything the command line asked for
+struct Options
+{
+  string outDir;        // empty means load and report only
+  int numWorkers;
+  double fps;           // 0 leaves the frame rate alone
+  int keyEvery;         // 0 leaves the frames alone
+  int interpolation;    // KeyInterpolation to lerp with
+  int curve;            // CurveType to lerp with, -1 uses interpolation
+  double tcb[3];        // tension, continuity and bias for CURVE_TCB
+  vector<string> lockJoints;   // joints held still while they touch the ground
+  string limitsFile;           // IK limits and weights for locking, see BVH::LoadIKLimits
+  int precision;
+  bool useCache;
+  bool verifyCache;
+};
+
+static void Usage()
+{
+  printf("usage: bvhtool [options] <file or folder>...\n"
+         "  every .bvh is loaded, then optionally resampled, lerped and saved\n"
+         "  -o <folder>       save results here, nothing is saved without it\n"
+         "  -j <n>            files to work on at once (default one per core)\n"
+         "  --fps <rate>      resample to this many frames a second\n"
+         "  --key-every <n>   keep every nth frame as a keyframe and lerp the rest\n"
+         "  --rotations <how> lerp rotations as euler angles (default), slerp or nlerp\n"
+         "  --curve <name>    lerp along linear, catmull-rom or tcb curves\n"
+         "  --tcb <t,c,b>     tension, continuity and bias of tcb curves\n"
+         "  --lock <joint,..> hold these joints still while they touch the ground\n"
+         "  --limits <file>   joint limits and weights for the IK --lock does\n"
+         "  --precision <n>   decimal places to save with (default exact)\n"
+         "  --cache           read and write .bvhb caches next to the inputs\n"
+         "  --verify-cache    --cache, checking every frame of a cache before using it\n"
+         "\n"
+         "       bvhtool bench-parse [-j <n>] <file>...\n"
+         "  times MOTION parsing against the old strtok parser,\n"
+         "  -j parsing in n chunks at once rather than one per core\n"
+         "\n"
+         "       bvhtool bench-fk <file>...\n"
+         "  times forward kinematics against the glm::rotate version\n"
+         "\n"
+         "       bvhtool bench-lerp [--key-every <n>] <file>...\n"
+         "  times LerpKeyframes with euler, slerp, nlerp and catmull-rom in-betweens\n"
+         "\n"
+         "       bvhtool bench-ik [--iterations <n>] <file>...\n"
+         "  times the Jacobian, CCD and FABRIK solvers dragging every end joint\n"
+         "\n"
+         "       bvhtool selftest <file>...\n"
+         "  checks the fast paths against the slow ones, exiting with 1 if any differ\n");
+}
+
+static bool EndsWith(const string & text, const char * ending)
+{
+  size_t length = strlen(ending);
+  return text.size() >= length && text.compare(text.size() - length, length, ending) == 0;
+}
+
+static bool IsDirectory(const string & path)
+{
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+// folders give every .bvh directly inside them, anything else is taken as a file
+static void AddInputs(const string & path, vector<string> & files)
+{
+  if(!IsDirectory(path))
+  {
+    files.push_back(path);
+    return;
+  }
+
+  DIR * dir = opendir(path.c_str());
+  if(dir == NULL){ return; }
+
+  vector<string> found;
+  while(struct dirent * entry = readdir(dir))
+  {
+    string name = entry->d_name;
+    if(EndsWith(name, ".bvh")){ found.push_back(path + "/" + name); }
+  }
+  closedir(dir);
+
+  // readdir has no order, keep the output the same run to run
+  std::sort(found.begin(), found.end());
+  files.insert(files.end(), found.begin(), found.end());
+}
+
+static string BaseName(const string & path)
+{
+  size_t slash = path.find_last_of("/\\");
+  return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+// Holds each joint where it landed for every run of frames it spends
+// planted on the ground, y being up, then IK bends the limbs above to
+// keep it there. Cleans up feet sliding about.
+static bool LockJoints(BVH & bvh, const vector<string> & names, string & report)
+{
+  vector<int> effectors;
+  for(size_t n = 0; n < names.size(); n++)
+  {
+    map<string, BVH::Joint *>::iterator found = bvh.jointIndex.find(names[n]);
+    if(found == bvh.jointIndex.end()){ report = bvh.fileName + ": has no joint " + names[n]; return false; }
+    effectors.push_back(found->second->index);
+  }
+
+  int numFrame = bvh.numFrame;
+  int numEffectors = effectors.size();
+  int numJoints = bvh.joints.size();
+  vector<glm::vec3> positions((size_t)numFrame * numJoints);
+  bvh.ClipPoses(0, numFrame, positions.data(), NULL);
+
+  // every joint follows its own path unless it is held
+  vector<glm::dvec3> goals((size_t)numFrame * numEffectors);
+  int blendFrames = max(1, (int)(LOCK_BLEND / bvh.interval + 0.5));
+  int numLocks = 0;
+  double longestReach = 0.;
+  for(int e = 0; e < numEffectors; e++)
+  {
+    int j = effectors[e];
+    double reach = 0.;
+    for(BVH::Joint * joint = bvh.joints[j]; joint->parent != NULL; joint = joint->parent)
+    {
+      reach += glm::length(glm::dvec3(joint->offset[0], joint->offset[1], joint->offset[2]));
+    }
+    longestReach = max(longestReach, reach);
+
+    float lowest = positions[j].y;
+    for(int f = 1; f < numFrame; f++){ lowest = min(lowest, positions[(size_t)f * numJoints + j].y); }
+
+    glm::dvec3 held;
+    int lastHeld = -1;
+    for(int f = 0; f < numFrame; f++)
+    {
+      int before = max(f - 1, 0), after = min(f + 1, numFrame - 1);
+      glm::vec3 position = positions[(size_t)f * numJoints + j];
+      glm::vec3 moved = positions[(size_t)after * numJoints + j] - positions[(size_t)before * numJoints + j];
+      double speed = glm::length(moved) / (max(after - before, 1) * bvh.interval);
+      glm::dvec3 & goal = goals[(size_t)f * numEffectors + e];
+
+      if(position.y - lowest <= LOCK_HEIGHT * reach && speed <= LOCK_SPEED * reach)
+      {
+        // held where it first touched down
+        if(lastHeld != f - 1 || f == 0)
+        {
+          held = glm::dvec3(position);
+          numLocks++;
+        }
+        goal = held;
+        lastHeld = f;
+      }
+      else if(lastHeld >= 0 && f - lastHeld <= blendFrames)
+      {
+        goal = glm::mix(held, glm::dvec3(position), (double)(f - lastHeld) / (blendFrames + 1));
+      }
+      else
+      {
+        goal = glm::dvec3(position);
+      }
+    }
+  }
+
+  // close enough is a ten thousandth of the longest limb, any looser
+  // and the held joint wobbles about by that much frame to frame
+  bvh.ikMaxIterations = 20;
+  bvh.ikTolerance = 1e-4 * longestReach;
+  vector<double> errors(numFrame);
+  if(!bvh.SolveClipIK(effectors, goals, 0, numFrame, errors.data()))
+  {
+    report = bvh.fileName + ": could not lock joints";
+    return false;
+  }
+
+  char line[128];
+  snprintf(line, sizeof(line), ", locked %d contacts to within %.3g", numLocks,
+           *std::max_element(errors.begin(), errors.end()));
+  report += line;
+  return true;
+}
+
+// Load, then each step the options ask for, then save.
+// report gets a line saying what happened either way.
+static bool ProcessFile(const string & file, const Options & options, string & report)
+{
+  BVH bvh;
+  bvh.useMotionCache = options.useCache;
+  bvh.verifyMotionCache = options.verifyCache;
+  bvh.useStreaming = false;   // nobody is waiting to draw the first frame
+  bvh.savePrecision = options.precision;
+  bvh.Load(file.c_str());
+  if(!bvh.isLoadSuccess){ report = file + ": could not be loaded"; return false; }
+
+  // space the whole body covers over the clip
+  bvh.FindMinMax();
+
+  char line[512];
+  snprintf(line, sizeof(line), "%s: %d joints, %d frames at %.4g fps, %.4g x %.4g x %.4g",
+           file.c_str(), (int)bvh.joints.size(), bvh.numFrame, 1. / bvh.interval,
+           bvh.maxCoords.x - bvh.minCoords.x, bvh.maxCoords.y - bvh.minCoords.y,
+           bvh.maxCoords.z - bvh.minCoords.z);
+  report = line;
+
+  if(options.fps > 0.)
+  {
+    if(!bvh.Resample(1. / options.fps)){ report = file + ": could not be resampled"; return false; }
+    snprintf(line, sizeof(line), ", resampled to %d frames", bvh.numFrame);
+    report += line;
+  }
+
+  if(options.keyEvery > 0 && bvh.numFrame > 1)
+  {
+    bvh.keyframes.Clear();
+    for(int i = 0; i < bvh.numFrame; i += options.keyEvery){ bvh.keyframes.Add(i); }
+    bvh.keyframes.Add(bvh.numFrame - 1);
+    bvh.interpolation = options.interpolation;
+    if(options.curve >= 0)
+    {
+      bvh.interpolation = INTERPOLATE_SPLINE;
+      bvh.SetCurves(options.curve);
+      for(int c = 0; c < bvh.numChannel; c++){ bvh.SetTCB(c, options.tcb[0], options.tcb[1], options.tcb[2]); }
+    }
+    bvh.LerpKeyframes();
+    snprintf(line, sizeof(line), ", lerped between %d keyframes", bvh.keyframes.Count());
+    report += line;
+  }
+
+  // after lerping, which would undo it
+  if(!options.limitsFile.empty() && !bvh.LoadIKLimits(options.limitsFile.c_str()))
+  {
+    report = file + ": could not read " + options.limitsFile;
+    return false;
+  }
+  if(!options.lockJoints.empty() && !LockJoints(bvh, options.lockJoints, report)){ return false; }
+
+  if(!options.outDir.empty())
+  {
+    string outFile = options.outDir + "/" + BaseName(file);
+    if(!bvh.SaveFile(outFile)){ report = file + ": could not save " + outFile; return false; }
+    report += ", saved " + outFile;
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc > 1 && strcmp(argv[1], "bench-parse") == 0)
+  {
+    bool hasChunks = argc > 3 && strcmp(argv[2], "-j") == 0;
+    int numChunks = hasChunks ? max(1, atoi(argv[3])) : 0;
+    return BenchmarkMotionParsing(argc - (hasChunks ? 4 : 2), argv + (hasChunks ? 4 : 2), numChunks);
+  }
+  if(argc > 1 && strcmp(argv[1], "bench-fk") == 0)
+  {
+    return BenchmarkForwardKinematics(argc - 2, argv + 2);
+  }
+  if(argc > 1 && strcmp(argv[1], "bench-lerp") == 0)
+  {
+    bool hasSpacing = argc > 3 && strcmp(argv[2], "--key-every") == 0;
+    int keySpacing = hasSpacing ? max(1, atoi(argv[3])) : 10;
+    return BenchmarkKeyframeInterpolation(argc - (hasSpacing ? 4 : 2), argv + (hasSpacing ? 4 : 2), keySpacing);
+  }
+  if(argc > 1 && strcmp(argv[1], "bench-ik") == 0)
+  {
+    bool hasIterations = argc > 3 && strcmp(argv[2], "--iterations") == 0;
+    int maxIterations = hasIterations ? max(1, atoi(argv[3])) : 20;
+    return BenchmarkInverseKinematics(argc - (hasIterations ? 4 : 2), argv + (hasIterations ? 4 : 2), maxIterations);
+  }
+  if(argc > 1 && strcmp(argv[1], "selftest") == 0)
+  {
+    return SelfTest(argc - 2, argv + 2);
+  }
+
+  Options options;
+  options.numWorkers = NumWorkers();
+  options.fps = 0.;
+  options.keyEvery = 0;
+  options.interpolation = INTERPOLATE_EULER;
+  options.curve = -1;
+  options.tcb[0] = options.tcb[1] = options.tcb[2] = 0.;
+  options.precision = -1;
+  options.useCache = false;
+  options.verifyCache = false;
+
+  vector<string> files;
+  for(int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if     (arg == "-o" && hasValue)           { options.outDir = argv[++i]; }
+    else if(arg == "-j" && hasValue)           { options.numWorkers = max(1, atoi(argv[++i])); }
+    else if(arg == "--fps" && hasValue)        { options.fps = atof(argv[++i]); }
+    else if(arg == "--key-every" && hasValue)  { options.keyEvery = atoi(argv[++i]); }
+    else if(arg == "--rotations" && hasValue)
+    {
+      string name = argv[++i];
+      if     (name == "euler")  { options.interpolation = INTERPOLATE_EULER; }
+      else if(name == "slerp")  { options.interpolation = INTERPOLATE_SLERP; }
+      else if(name == "nlerp")  { options.interpolation = INTERPOLATE_NLERP; }
+      else                      { Usage(); return 1; }
+    }
+    else if(arg == "--curve" && hasValue)
+    {
+      string name = argv[++i];
+      if     (name == "linear")       { options.curve = CURVE_LINEAR; }
+      else if(name == "catmull-rom")  { options.curve = CURVE_CATMULL_ROM; }
+      else if(name == "tcb")          { options.curve = CURVE_TCB; }
+      else                            { Usage(); return 1; }
+    }
+    else if(arg == "--tcb" && hasValue)
+    {
+      if(sscanf(argv[++i], "%lf,%lf,%lf", &options.tcb[0], &options.tcb[1], &options.tcb[2]) != 3){ Usage(); return 1; }
+      options.curve = CURVE_TCB;
+    }
+    else if(arg == "--lock" && hasValue)
+    {
+      string names = argv[++i];
+      for(size_t start = 0, comma; start <= names.size(); start = comma + 1)
+      {
+        comma = names.find(',', start);
+        if(comma == string::npos){ comma = names.size(); }
+        if(comma > start){ options.lockJoints.push_back(names.substr(start, comma - start)); }
+      }
+    }
+    else if(arg == "--limits" && hasValue)     { options.limitsFile = argv[++i]; }
+    else if(arg == "--precision" && hasValue)  { options.precision = atoi(argv[++i]); }
+    else if(arg == "--cache")                  { options.useCache = true; }
+    else if(arg == "--verify-cache")           { options.useCache = options.verifyCache = true; }
+    else if(arg == "-h" || arg == "--help")    { Usage(); return 0; }
+    else if(arg[0] == '-')                     { Usage(); return 1; }
+    else                                       { AddInputs(arg, files); }
+  }
+
+  if(files.empty()){ Usage(); return 1; }
+
+  if(!options.outDir.empty() && !IsDirectory(options.outDir) && mkdir(options.outDir.c_str(), 0755) != 0)
+  {
+    fprintf(stderr, "%s: could not be created\n", options.outDir.c_str());
+    return 1;
+  }
+
+  // one file per worker at a time, reported as each one finishes
+  std::mutex printLock;
+  int numFailed = 0;
+  ParallelForEach((int)files.size(), options.numWorkers, [&](int item, int)
+  {
+    string report;
+    bool success = ProcessFile(files[item], options, report);
+
+    std::lock_guard<std::mutex> lock(printLock);
+    if(!success)
+    {
+      fprintf(stderr, "%s\n", report.c_str());
+      numFailed++;
+    }
+    else
+    {
+      printf("%s\n", report.c_str());
+    }
+  });
+
+  printf("%d of %d files done\n", (int)files.size() - numFailed, (int)files.size());
+  return numFailed == 0 ? 0 : 1;
+}